@@ -27,17 +27,69 @@
 #include <stdint.h>
 #include <string.h>
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sysexits.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
 #include <assert.h>
 
 #include <iostream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
 
 #include <gmpxx.h>
 
 #define	MAXVAR 65536
+#define	HEADER_WIDTH 64
+#define	FORMAT_DIMACS 0
+#define	FORMAT_HPRSAT 1
+#define	FORMAT_BINARY 2
+#define	FORMAT_COUNT 3
+#define	FORMAT_XCNF 4
+#define	FORMAT_ICNF 5
+#define	XOR_CHAIN_MAX 32	/* literals per XOR line */
+#define	BVE_OCC_MAX 16		/* occurrences of an eliminated variable */
+#define	BVE_CLAUSE_MAX 16	/* literals per resolvent */
+#define	SUBSUME_CLAUSE_MAX 16	/* literals per subsuming clause */
+
+#define	OUTBUF_SIZE (1U << 20)
+#define	OUTBUF_SLACK 256	/* room for any single expression */
+#define	VAR_POOL_CHUNK (1U << 22)	/* bytes */
+#define	GATE_HASH_BITS 16	/* default log2 entries */
+#define	GATE_HASH_WAYS 4	/* entries per bucket */
+#define	MUL_THRESHOLD 32	/* default bits for schoolbook base case */
+#define	MUL_TOOM3_FACTOR 16	/* Toom-3 above this times the threshold */
+#define	MUL_SCHOOLBOOK 0
+#define	MUL_KARATSUBA 1
+#define	MUL_TOOM3 2
+#define	MUL_DADDA 3
+#define	CARD_TOTALIZER 0
+#define	CARD_SEQUENTIAL 1
+#define	CARD_SORTER 2
+#define	CARD_ADDER 3
+#define	DIV_RESTORING 0
+#define	DIV_NON_RESTORING 1
+#define	ADD_SELASKY 0
+#define	ADD_RIPPLE 1
+#define	ADD_KOGGE_STONE 2
+#define	ADD_BRENT_KUNG 3
+#define	ADD_SKLANSKY 4
+#define	OP_AND 0
+#define	OP_XOR 1
+#define	OP_OR 2
+#define	OP_XOR3 3
+#define	OP_MAJ3 4
+#define	OP_ADD3 5		/* recorded by the cone sink only */
+#define	OP_CONST 6
+#define	OP_EQUAL 7
 
 static int varnum;
 static int nexpr;
@@ -50,6 +102,7 @@ static int function;
 static mpz_class a_value;
 static mpz_class b_value;
 static mpz_class r_value;
+static mpz_class m_value;
 static int greater;
 static int rounded;
 static int varlimit;
@@ -58,443 +111,3709 @@ static int do_parse;
 static int has_a_value;
 static int has_b_value;
 static int has_r_value;
+static int has_m_value;
+
+/* values replacing -A, -B and -v, for one target of -T or -L */
+struct target_t {
+	mpz_class value[3];
+	bool has[3];
+};
+
+static std::vector<target_t> targets;
+static target_t target_base;	/* values from the command line */
+static std::vector<int> target_act;	/* activation literal by target */
+static std::vector<std::vector<int> > target_data;	/* clauses by target */
+static int guard;	/* activation literal of emitted constraints, if any */
+static int shared_comments;	/* the comments serve several values */
+static int batch;
+static const char *cache_dir;
+static int cache;	/* generating a circuit for the cache of -K */
+static int cache_values;	/* the cached circuit depends on the values */
+static std::vector<int> cache_map[3];	/* literals of a, b and r */
+static uintmax_t cache_hits;
+static uintmax_t cache_misses;
+static size_t exp_window = 1;
+static int bind_constants;
+static int simplify;
+static std::vector<char> frozen;	/* by variable, kept by simplify */
+static int prune;
+static int mul_engine = MUL_SCHOOLBOOK;
+static size_t mul_threshold = MUL_THRESHOLD;
+static int adder = ADD_SELASKY;
+static int divider = DIV_RESTORING;
+static int card_encoder = CARD_TOTALIZER;
+static std::vector<mpz_class> weights;
+static uintmax_t cone_gates;
+static uintmax_t cone_kept;
 static int output_format;
+static int output_comments = 1;
 static const char *comment = "c";
+static int single_pass;
+static const char *output_file;
+static const char *target_file;
+static const char optstring[] = "ghf:cb:rv:Vi:pA:B:Rso:SF:H:COM:t:a:d:m:w:e:W:T:L:K:j:";
+static int output_spool;
+static off_t output_base;
+static off_t header_offset = -1;
+static int header_limit;
+static int print_stats;
+static uintmax_t var_pool_allocs;
+static uintmax_t var_pool_chunks;
+static struct timespec start_time;
+
+static char outbuf[OUTBUF_SIZE];
+static size_t outlen;
+static off_t outpos;
+static int outfd = STDOUT_FILENO;
+
+static const char out_digits[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
 
-#define	outcnf(...) do { \
-    if (runs) \
-	std::cout << __VA_ARGS__; \
-} while (0)
+static void
+out_write(int fd, const char *ptr, size_t len)
+{
+	while (len != 0) {
+		ssize_t ret = write(fd, ptr, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EX_IOERR, "Cannot write output");
+		}
+		ptr += ret;
+		len -= ret;
+	}
+}
 
-#define	outvar(v) do { \
-    if ((v) < 0) \
-	outcnf("(1 - v" << -v << ")"); \
-    else \
-        outcnf("v" << v); \
-} while (0)
+static void
+out_flush(void)
+{
+	out_write(outfd, outbuf, outlen);
+	outpos += outlen;
+	outlen = 0;
+}
 
-static int
-new_variable(void)
+/*
+ * The out_xxx() functions below do not check for space in the output
+ * buffer. Call out_reserve() with OUTBUF_SLACK before every expression.
+ */
+static inline void
+out_reserve(size_t len)
 {
-	return (varnum++);
+	if (outlen + len > sizeof(outbuf))
+		out_flush();
 }
 
-class variable_t {
-public:
-	int v;
-	variable_t(void) {
-		v = zerovar;
-		assert(v != 0);
-	};
-	variable_t(int other) {
-		v = other;
-		assert(v != 0);
-	};
-	variable_t &operator =(int other) {
-		v = other;
-		assert(v != 0);
-		return (*this);
-	};
-	void toggleInverted(void);
-	bool isInverted(void);
-	void equal_to_const(bool) const;
-	void equal_to_var(const variable_t &other) const;
+static inline void
+out_char(char c)
+{
+	outbuf[outlen++] = c;
+}
 
-	variable_t operator ~(void) const {
-		variable_t ret = -v;
-		assert(v != 0);
-		return (ret);
-	};
-	variable_t operator &(const variable_t &) const;
-	variable_t &operator &=(const variable_t &);
-	variable_t operator ^(const variable_t &) const;
-	variable_t &operator ^=(const variable_t &);
-	variable_t operator |(const variable_t &) const;
-	variable_t &operator |=(const variable_t &);
-};
+static inline void
+out_str(const char *str)
+{
+	const size_t len = strlen(str);
 
-static void
-do_cnf_reset(void)
+	memcpy(outbuf + outlen, str, len);
+	outlen += len;
+}
+
+static inline void
+out_int(int value)
 {
-	old_varnum = varnum;
-	old_nexpr = nexpr;
-	varnum = 1;
-	nexpr = 0;
-	zerovar = new_variable();
+	char temp[16];
+	char *ptr = temp + sizeof(temp);
+	unsigned u;
+
+	if (value < 0) {
+		out_char('-');
+		u = -(unsigned)value;
+	} else {
+		u = value;
+	}
+
+	while (u >= 100) {
+		const unsigned r = (u % 100) * 2;
+		u /= 100;
+		*--ptr = out_digits[r + 1];
+		*--ptr = out_digits[r];
+	}
+	if (u >= 10) {
+		*--ptr = out_digits[2 * u + 1];
+		*--ptr = out_digits[2 * u];
+	} else {
+		*--ptr = '0' + u;
+	}
+	memcpy(outbuf + outlen, ptr, temp + sizeof(temp) - ptr);
+	outlen += temp + sizeof(temp) - ptr;
 }
 
-static void
-do_cnf_header(void)
+static inline void
+out_var(int v)
 {
-	if (output_format != 0) {
-		outcnf(comment << " " << (old_varnum - 1) << " variables and " << old_nexpr << " expressions\n");
-		outcnf("v0\n");
-		outcnf("v1\n");
+	if (v < 0) {
+		out_str("(1 - v");
+		out_int(-v);
+		out_char(')');
 	} else {
-		if (varlimit)
-			outcnf("p cnf " << old_varnum - 1 << " " << old_nexpr << " " << varnum - 1 << "\n");
-		else
-			outcnf("p cnf " << old_varnum - 1 << " " << old_nexpr << "\n");
+		out_char('v');
+		out_int(v);
+	}
+}
 
-		(variable_t(zerovar)).equal_to_const(false);
+static void
+out_string(const std::string &str)
+{
+	const char *ptr = str.data();
+	size_t len = str.size();
+
+	while (len != 0) {
+		size_t n = sizeof(outbuf) - outlen;
+
+		if (n == 0) {
+			out_flush();
+			continue;
+		}
+		if (n > len)
+			n = len;
+		memcpy(outbuf + outlen, ptr, n);
+		outlen += n;
+		ptr += n;
+		len -= n;
 	}
 }
 
-class var_t {
+#define	outcnf(...) do { \
+    if (runs && output_comments) { \
+	std::ostringstream outstr; \
+	outstr << __VA_ARGS__; \
+	out_string(outstr.str()); \
+    } \
+} while (0)
+
+static int
+new_variable(void)
+{
+	return (varnum++);
+}
+
+/*
+ * A sink receives the gates and constraints of the circuit being
+ * built, and decides how they are encoded and serialized. The gate
+ * functions allocate and return the variable holding the result.
+ */
+class sink_t {
 public:
-	variable_t *z;
+	virtual ~sink_t() {};
+	virtual void reset(void) {};
+	virtual int gate_and(int, int) = 0;
+	virtual int gate_xor(int, int) = 0;
+	virtual int gate_or(int, int) = 0;
+	virtual int gate_xor3(int, int, int) = 0;
+	virtual int gate_maj3(int, int, int) = 0;
+	virtual void gate_add3(int, int, int, int &, int &) = 0;
+	virtual void equal_to_const(int, bool) = 0;
+	virtual void equal_to_var(int, int) = 0;
+};
 
-	var_t(void) {
-		z = new variable_t [maxvar];
+/*
+ * Sink encoding all gates as CNF clauses of at most four literals.
+ * Derived classes only need to implement the clause() function.
+ */
+class cnf_sink_t : public sink_t {
+public:
+	virtual void clause(const int *, size_t) = 0;
+
+	void sorted(int *array, size_t num) {
+		size_t a;
+		size_t b;
+		size_t n;
+		int t;
+
+		for (a = 0; a != num; a++) {
+			assert(array[a] != 0);
+			for (b = a + 1; b != num; b++) {
+				if (array[a] > array[b]) {
+					t = array[b];
+					array[b] = array[a];
+					array[a] = t;
+				}
+			}
+		}
+
+		/* remove duplicates */
+		for (t = a = n = 0; a != num; a++) {
+			if (array[a] != t)
+				t = array[n++] = array[a];
+		}
+
+		nexpr++;
+		clause(array, n);
 	};
 
-	var_t(const variable_t &other) {
-		z = new variable_t [maxvar];
-		z[0] = other;
+	void triplet(int a, int b, int c) {
+		int array[3] = { a, b, c };
+
+		sorted(array, 3);
 	};
 
-	var_t(const var_t &other) {
-		z = new variable_t [maxvar];
+	void quad(int a, int b, int c, int d) {
+		int array[4] = { a, b, c, d };
 
-		for (size_t x = 0; x != maxvar; x++)
-			z[x] = other.z[x];
+		sorted(array, 4);
 	};
 
-	~var_t(void) {
-		delete [] z;
+	int gate_and(int v, int o) {
+		/*
+		 * Truth table:
+		 *
+		 * a v o  (a ^ v&o)
+		 * 0 0 0     0
+		 * 0 0 1     0
+		 * 0 1 0     0
+		 * 0 1 1     1
+		 * 1 0 0     1
+		 * 1 0 1     1
+		 * 1 1 0     1
+		 * 1 1 1     0
+		 */
+		const int a = new_variable();
+
+		triplet(a, -v, -o);
+		triplet(-a, v, o);
+		triplet(-a, v, -o);
+		triplet(-a, -v, o);
+
+		return (a);
 	};
 
-	var_t &operator =(const var_t &other) {
-		if (&other != this) {
-			for (size_t x = 0; x != maxvar; x++)
-				z[x] = other.z[x];
-		}
-		return (*this);
+	int gate_xor(int v, int o) {
+		const int a = new_variable();
+
+		triplet(a, v, -o);
+		triplet(a, -v, o);
+		triplet(-a, v, o);
+		triplet(-a, -v, -o);
+
+		return (a);
 	};
 
-	void alloc(size_t max = maxvar, bool is_signed = false) {
-		for (size_t x = 0; x != max; x++)
-			z[x].v = new_variable();
-		for (size_t x = max; x != maxvar; x++)
-			z[x].v = is_signed ? z[max - 1].v : zerovar;
+	int gate_or(int v, int o) {
+		const int a = new_variable();
+
+		triplet(a, v, -o);
+		triplet(a, -v, o);
+		triplet(a, -v, -o);
+		triplet(-a, v, o);
+
+		return (a);
 	};
 
-	void from_const(uint64_t var) {
-		for (size_t x = 0; x != maxvar; x++) {
-			if (x >= 64)
-				z[x] = zerovar;
-			else
-				z[x] = ((var >> x) & 1) ? -zerovar : zerovar;
+	int gate_xor3(int v, int o, int p) {
+		const int a = new_variable();
+
+		/* forbid every assignment where "a" is not the parity */
+		for (int x = 0; x != 8; x++) {
+			const bool pv = (x & 1);
+			const bool po = (x & 2);
+			const bool pp = (x & 4);
+
+			quad(pv ? -v : v, po ? -o : o, pp ? -p : p,
+			    (pv ^ po ^ pp) ? a : -a);
 		}
+		return (a);
 	};
 
-	void equal_to_const(bool other) const {
-		for (size_t x = 0; x != maxvar; x++)
-			z[x].equal_to_const(other);
-	};
+	int gate_maj3(int v, int o, int p) {
+		const int a = new_variable();
 
-	void equal_to_var(const var_t &other) const {
-		for (size_t x = 0; x != maxvar; x++)
-			z[x].equal_to_var(other.z[x]);
-	};
+		triplet(a, -v, -o);
+		triplet(a, -v, -p);
+		triplet(a, -o, -p);
+		triplet(-a, v, o);
+		triplet(-a, v, p);
+		triplet(-a, o, p);
 
-	var_t operator ~(void) const {
-		var_t r = *this;
-		for (size_t x = 0; x != maxvar; x++)
-			r.z[x] = ~r.z[x];
-		return (r);
+		return (a);
 	};
 
-	var_t operator ^(const var_t &other) const {
-		var_t c;
-		for (size_t x = 0; x != maxvar; x++)
-			c.z[x] = z[x] ^ other.z[x];
-		return (c);
-	};
+	void gate_add3(int v, int o, int p, int &s, int &c) {
+		s = gate_xor3(v, o, p);
+		c = gate_maj3(v, o, p);
 
-	var_t &operator ^=(const var_t &other) {
-		*this = *this ^ other;
-		return (*this);
+		/*
+		 * Redundant clauses which help unit propagation:
+		 * all inputs are set when both outputs are set,
+		 * and cleared when both outputs are cleared.
+		 */
+		triplet(-s, -c, v);
+		triplet(-s, -c, o);
+		triplet(-s, -c, p);
+		triplet(s, c, -v);
+		triplet(s, c, -o);
+		triplet(s, c, -p);
 	};
 
-	var_t operator ^(const variable_t &other) const {
-		var_t c;
-		for (size_t x = 0; x != maxvar; x++)
-			c.z[x] = z[x] ^ other;
-		return (c);
-	};
+	/* constraints only apply when the guard literal is set */
+	void equal_to_const(int v, bool value) {
+		const int lits[2] = { value ? v : -v, -guard };
 
-	var_t operator &(const var_t &other) const {
-		var_t c;
-		for (size_t x = 0; x != maxvar; x++)
-			c.z[x] = z[x] & other.z[x];
-		return (c);
+		nexpr++;
+		clause(lits, guard ? 2 : 1);
 	};
 
-	var_t &operator &=(const var_t &other) {
-		*this = *this & other;
-		return (*this);
+	void equal_to_var(int v, int o) {
+		int lits[3];
+
+		nexpr += 2;
+
+		lits[0] = -v;
+		lits[1] = o;
+		lits[2] = -guard;
+		clause(lits, guard ? 3 : 2);
+
+		lits[0] = v;
+		lits[1] = -o;
+		clause(lits, guard ? 3 : 2);
 	};
+};
 
-	var_t operator &(const variable_t &other) const {
-		var_t c;
-		for (size_t x = 0; x != maxvar; x++)
-			c.z[x] = z[x] & other;
-		return (c);
+/* Sink writing DIMACS text */
+class dimacs_sink_t : public cnf_sink_t {
+public:
+	void clause(const int *lits, size_t n) {
+		out_reserve(12 * n + 4);
+		for (size_t x = 0; x != n; x++) {
+			out_int(lits[x]);
+			out_char(' ');
+		}
+		out_str("0\n");
 	};
+};
 
-	var_t operator |(const var_t &other) const {
-		var_t c;
-		for (size_t x = 0; x != maxvar; x++)
-			c.z[x] = z[x] | other.z[x];
-		return (c);
+/*
+ * Sink writing DIMACS text, where XOR gates are written as native XOR
+ * constraints in the "x" line format of CryptoMiniSat. A line lists
+ * literals whose XOR must be true.
+ *
+ * XOR gates are kept pending until their output is used by something
+ * else than another XOR gate. Only then the gate is written, with any
+ * pending XOR gates among its inputs expanded, so that a whole chain
+ * of XOR gates becomes a single line. Gates which are only used by
+ * other XOR gates are never written.
+ */
+class xcnf_sink_t : public dimacs_sink_t {
+	struct xnode_t {
+		int in[3];	/* zero when unused */
+		int len;	/* literals after expansion */
 	};
+	std::vector<uint32_t> pending;	/* index + 1 into "nodes" by variable */
+	std::vector<xnode_t> nodes;
+	std::vector<int> line;
 
-	var_t &operator |=(const var_t &other) {
-		*this = *this | other;
-		return (*this);
+	static bool compare_abs(int a, int b) {
+		return (abs(a) < abs(b));
 	};
 
-	var_t operator |(const variable_t &other) const {
-		var_t c;
-		for (size_t x = 0; x != maxvar; x++)
-			c.z[x] = z[x] | other;
-		return (c);
+	bool is_pending(int v) const {
+		v = abs(v);
+		return ((size_t)v < pending.size() && pending[v] != 0);
 	};
 
-	var_t operator <<(size_t shift) const {
-		var_t c;
-		if (shift < maxvar) {
-			for (size_t x = 0; x != maxvar - shift; x++)
-				c.z[x + shift] = z[x];
+	/* append the literals "v" is the XOR of */
+	void expand(int v, std::vector<int> &out) const {
+		if (!is_pending(v)) {
+			out.push_back(v);
+			return;
 		}
-		return (c);
+
+		const xnode_t &node = nodes[pending[abs(v)] - 1];
+
+		for (size_t x = 0; x != 3 && node.in[x] != 0; x++)
+			expand(node.in[x], out);
+
+		/* the constant true literal inverts the XOR */
+		if (v < 0)
+			out.push_back(-zerovar);
 	};
 
-	var_t operator >>(size_t shift) const {
-		var_t c;
-		if (shift < maxvar) {
-			for (size_t x = shift; x != maxvar; x++)
-				c.z[x - shift] = z[x];
+	/* cancel out duplicate variables and constants */
+	static void normalize(std::vector<int> &lits) {
+		bool inverted = false;
+		size_t n = 0;
+
+		std::sort(lits.begin(), lits.end(), compare_abs);
+		for (size_t x = 0; x != lits.size(); x++) {
+			if (lits[x] == zerovar) {
+				continue;
+			} else if (lits[x] == -zerovar) {
+				inverted = !inverted;
+			} else if (n != 0 && abs(lits[n - 1]) == abs(lits[x])) {
+				if (lits[n - 1] != lits[x])
+					inverted = !inverted;
+				n--;
+			} else {
+				lits[n++] = lits[x];
+			}
+		}
+		lits.resize(n);
+
+		if (inverted) {
+			if (n != 0)
+				lits[0] = -lits[0];
+			else
+				lits.push_back(-zerovar);
 		}
-		return (c);
 	};
 
-	var_t operator +(const var_t &other) const {
-		const var_t &a = *this;
-		const var_t &b = other;
-		var_t c;
+	/* write the gate driving "v", if pending */
+	void flush(int v) {
+		if (!is_pending(v))
+			return;
+		v = abs(v);
 
-		c.alloc();
+		line.clear();
+		expand(v, line);
+		pending[v] = 0;
+		normalize(line);
 
-		/*
-		 * Build equation for addition after HP Selasky 2021:
-		 * a + b = c
-		 */
-		var_t t = (a ^ b);
-		var_t u = (a | b);
+		/* v ^ line = 0 */
+		line.push_back(-v);
+		xclause(line.data(), line.size());
+	};
 
-		(t ^ c ^ (u << 1) ^ ((t & c) << 1)).equal_to_const(false);
+	int gate_xorn(const int *in, size_t num) {
+		const int a = new_variable();
+		xnode_t node = {};
 
-		return (c);
+		for (size_t x = 0; x != num; x++) {
+			node.in[x] = in[x];
+			node.len += is_pending(in[x]) ?
+			    nodes[pending[abs(in[x])] - 1].len : 1;
+		}
+
+		/* chain too long, start a new one */
+		if (node.len > XOR_CHAIN_MAX) {
+			for (size_t x = 0; x != num; x++)
+				flush(in[x]);
+			node.len = num;
+		}
+
+		if (pending.size() <= (size_t)a)
+			pending.resize(a + 1 + (a / 2), 0);
+		nodes.push_back(node);
+		pending[a] = nodes.size();
+		return (a);
 	};
 
-	var_t &operator +=(const var_t &other) {
-		*this = *this + other;
-		return (*this);
+public:
+	void reset(void) {
+		pending.clear();
+		nodes.clear();
 	};
 
-	var_t operator -(const var_t &other) const {
-		var_t a;
-		const var_t &b = other;
-		const var_t &c = *this;
+	/* the counting pass goes through this sink, too */
+	void clause(const int *lits, size_t n) {
+		for (size_t x = 0; x != n; x++)
+			flush(lits[x]);
+		if (runs != 0)
+			dimacs_sink_t::clause(lits, n);
+	};
 
-		a.alloc();
+	void xclause(const int *lits, size_t n) {
+		nexpr++;
+
+		if (runs == 0)
+			return;
+
+		out_reserve(12 * n + 4);
+		out_char('x');
+		for (size_t x = 0; x != n; x++) {
+			out_int(lits[x]);
+			out_char(' ');
+		}
+		out_str("0\n");
+	};
+
+	int gate_xor(int v, int o) {
+		const int in[2] = { v, o };
+
+		return (gate_xorn(in, 2));
+	};
+
+	int gate_xor3(int v, int o, int p) {
+		const int in[3] = { v, o, p };
+
+		return (gate_xorn(in, 3));
+	};
+};
+
+/*
+ * Sink writing clauses as a compact binary stream after the DIMACS
+ * header line. Each literal is mapped to (2 * |v| + (v < 0)) and
+ * written as a little endian base 128 number. A zero byte terminates
+ * every clause.
+ */
+class binary_sink_t : public cnf_sink_t {
+public:
+	void clause(const int *lits, size_t n) {
+		out_reserve(5 * n + 1);
+		for (size_t x = 0; x != n; x++) {
+			uint32_t u = (lits[x] < 0) ?
+			    (2U * -lits[x] + 1) : (2U * lits[x]);
+			while (u >= 0x80) {
+				out_char((u & 0x7F) | 0x80);
+				u >>= 7;
+			}
+			out_char(u);
+		}
+		out_char(0);
+	};
+};
+
+/* Sink keeping all clauses in memory, zero terminated */
+class memory_sink_t : public cnf_sink_t {
+public:
+	std::vector<int> data;
+
+	void reset(void) {
+		data.clear();
+	};
+
+	void clause(const int *lits, size_t n) {
+		data.insert(data.end(), lits, lits + n);
+		data.push_back(0);
+	};
 
+	void replay(cnf_sink_t &other) const {
+		for (size_t x = 0, y; x != data.size(); x = y + 1) {
+			for (y = x; data[y] != 0; y++)
+				;
+			other.clause(&data[x], y - x);
+		}
+	};
+};
+
+/* Sink only counting clauses */
+class count_sink_t : public cnf_sink_t {
+public:
+	void clause(const int *, size_t) {
+	};
+};
+
+/* Sink writing polynomial expressions for hpRsat */
+class hprsat_sink_t : public sink_t {
+public:
+	int gate_and(int v, int o) {
 		/*
-		 * Build equation for addition after HP Selasky 2021:
-		 * a = c - b
+		 * Truth table:
+		 * a + b - 2 * c - d = 0
 		 */
-		var_t t = (a ^ b);
-		var_t u = (a | b);
+		const int c = new_variable();
+		const int d = new_variable();
 
-		(t ^ c ^ (u << 1) ^ ((t & c) << 1)).equal_to_const(false);
+		nexpr++;
 
-		return (a);
+		if (runs != 0) {
+			out_reserve(OUTBUF_SLACK);
+			out_var(v);
+			out_str(" + ");
+			out_var(o);
+			out_str(" - 2 * ");
+			out_var(c);
+			out_str(" - ");
+			out_var(d);
+			out_char('\n');
+		}
+		return (c);
 	};
 
-	var_t &operator -=(const var_t &other) {
-		*this = *this - other;
-		return (*this);
+	int gate_xor(int v, int o) {
+		/*
+		 * Truth table:
+		 * a + b - 2 * c - d = 0
+		 */
+		const int c = new_variable();
+		const int d = new_variable();
+
+		nexpr++;
+
+		if (runs != 0) {
+			out_reserve(OUTBUF_SLACK);
+			out_var(v);
+			out_str(" + ");
+			out_var(o);
+			out_str(" + ");
+			out_var(c);
+			out_str(" - 2 * ");
+			out_var(d);
+			out_char('\n');
+		}
+		return (c);
 	};
 
-	var_t polar_add(const var_t &other) const {
-		var_t r;
-		r.alloc();
+	int gate_or(int v, int o) {
+		/*
+		 * Truth table:
+		 * a | b = a ^ b ^ (a & b)
+		 */
+		const int y = gate_and(v, o);
+		const int x = gate_xor(v, o);
 
-		const var_t c = (*this & other) ^ (*this & r) ^ (other & r);
+		return (gate_xor(x, y));
+	};
 
-		(*this ^ other ^ r ^ (c << 1)).equal_to_const(false);
+	void gate_add3(int v, int o, int p, int &s, int &d) {
+		/*
+		 * Truth table:
+		 * a + b + c - s - 2 * d = 0
+		 */
+		s = new_variable();
+		d = new_variable();
 
-		return (r);
+		nexpr++;
+
+		if (runs != 0) {
+			out_reserve(OUTBUF_SLACK);
+			out_var(v);
+			out_str(" + ");
+			out_var(o);
+			out_str(" + ");
+			out_var(p);
+			out_str(" - ");
+			out_var(s);
+			out_str(" - 2 * ");
+			out_var(d);
+			out_char('\n');
+		}
 	};
 
-	var_t polar_mul(const var_t &other) const {
-		var_t r;
-		var_t c;
+	int gate_xor3(int v, int o, int p) {
+		int s;
+		int d;
 
-		for (size_t x = 0; x != maxvar; x++) {
-			const var_t a = (*this & other.z[x]) << x;
+		gate_add3(v, o, p, s, d);
+		return (s);
+	};
 
-			var_t var;
-			var.alloc();
+	int gate_maj3(int v, int o, int p) {
+		int s;
+		int d;
+
+		gate_add3(v, o, p, s, d);
+		return (d);
+	};
+
+	void equal_to_const(int v, bool value) {
+		nexpr++;
+
+		if (runs == 0)
+			return;
+
+		out_reserve(OUTBUF_SLACK);
+		out_var(v);
+		out_str(value ? " - 1\n" : " - 0\n");
+	};
+
+	void equal_to_var(int v, int o) {
+		nexpr++;
+
+		if (runs == 0)
+			return;
+
+		out_reserve(OUTBUF_SLACK);
+		out_var(v);
+		out_str(" - ");
+		out_var(o);
+		out_char('\n');
+	};
+};
+
+static memory_sink_t memory_sink;
+static dimacs_sink_t dimacs_sink;
+static xcnf_sink_t xcnf_sink;
+static binary_sink_t binary_sink;
+static count_sink_t count_sink;
+static hprsat_sink_t hprsat_sink;
+static sink_t *sink = &count_sink;
+
+static sink_t *
+output_sink(void)
+{
+	switch (output_format) {
+	case FORMAT_HPRSAT:
+		return (&hprsat_sink);
+	case FORMAT_BINARY:
+		return (&binary_sink);
+	case FORMAT_COUNT:
+		return (&count_sink);
+	case FORMAT_XCNF:
+		return (&xcnf_sink);
+	default:
+		return (&dimacs_sink);
+	}
+}
+
+/*
+ * Sink recording the circuit as a DAG, used by -c. When a pass is
+ * complete, only the gates in the transitive fan-in of the asserted
+ * constraints are replayed into the real sink, which renumbers the
+ * variables. Variables not defined by a gate are always kept. Those
+ * holding the operands are allocated before any gate, and so keep
+ * their numbers for parsing the solution.
+ */
+class cone_sink_t : public sink_t {
+	struct event_t {
+		int op;
+		int vars;	/* variables allocated before the event */
+		int in[3];
+		int out[2];
+	};
+	std::vector<event_t> events;
+
+	int record(int op, int a, int b, int c, int outputs = 1) {
+		const event_t e = { op, varnum, { a, b, c }, { 0, 0 } };
+
+		events.push_back(e);
+		events.back().out[0] = new_variable();
+		if (outputs == 2)
+			events.back().out[1] = new_variable();
+		return (events.back().out[0]);
+	};
+
+	static int map_lit(const std::vector<int> &map, int l) {
+		return ((l < 0) ? -map[-l] : map[l]);
+	};
+
+public:
+	sink_t *inner;
+
+	void reset(void) {
+		events.clear();
+	};
+	bool empty(void) const {
+		return (events.empty());
+	};
+	int gate_and(int a, int b) {
+		return (record(OP_AND, a, b, 0));
+	};
+	int gate_xor(int a, int b) {
+		return (record(OP_XOR, a, b, 0));
+	};
+	int gate_or(int a, int b) {
+		return (record(OP_OR, a, b, 0));
+	};
+	int gate_xor3(int a, int b, int c) {
+		return (record(OP_XOR3, a, b, c));
+	};
+	int gate_maj3(int a, int b, int c) {
+		return (record(OP_MAJ3, a, b, c));
+	};
+	void gate_add3(int a, int b, int c, int &s, int &d) {
+		s = record(OP_ADD3, a, b, c, 2);
+		d = s + 1;
+	};
+	void equal_to_const(int v, bool value) {
+		const event_t e = { OP_CONST, varnum, { v, value, 0 }, { 0, 0 } };
+		events.push_back(e);
+	};
+	void equal_to_var(int v, int o) {
+		const event_t e = { OP_EQUAL, varnum, { v, o, 0 }, { 0, 0 } };
+		events.push_back(e);
+	};
+
+	void replay(void) {
+		const int num = varnum;
+		std::vector<char> live(num, 0);
+		std::vector<char> gate(num, 0);
+		std::vector<int> map(num, 0);
+		int next;
+
+		/* a gate is only used by the events following it */
+		for (size_t x = events.size(); x-- != 0; ) {
+			const event_t &e = events[x];
+			const int n = (e.op == OP_ADD3) ? 2 : 1;
+
+			if (e.op == OP_CONST) {
+				live[abs(e.in[0])] = 1;
+				continue;
+			} else if (e.op == OP_EQUAL) {
+				live[abs(e.in[0])] = 1;
+				live[abs(e.in[1])] = 1;
+				continue;
+			}
+			gate[e.out[0]] = 1;
+			gate[e.out[n - 1]] = 1;
+			cone_gates++;
+			if (!live[e.out[0]] && !live[e.out[n - 1]])
+				continue;
+			cone_kept++;
+			for (int y = 0; y != 3; y++)
+				live[abs(e.in[y])] = 1;
+		}
+
+		varnum = 1;
+		nexpr = 0;
+		map[zerovar] = new_variable();
+		next = zerovar + 1;
+
+		for (const event_t &e : events) {
+			for (; next < e.vars; next++) {
+				if (!gate[next])
+					map[next] = new_variable();
+			}
 
-			const var_t cn = (r & a) ^ (r & var) ^ (a & var);
+			const int a = map_lit(map, e.in[0]);
+			const int b = map_lit(map, e.in[1]);
+			const int c = map_lit(map, e.in[2]);
+
+			switch (e.op) {
+			case OP_CONST:
+				inner->equal_to_const(a, e.in[1]);
+				continue;
+			case OP_EQUAL:
+				inner->equal_to_var(a, b);
+				continue;
+			case OP_ADD3:
+				/* only build the outputs being used */
+				if (live[e.out[0]] && live[e.out[1]])
+					inner->gate_add3(a, b, c, map[e.out[0]], map[e.out[1]]);
+				else if (live[e.out[0]])
+					map[e.out[0]] = inner->gate_xor3(a, b, c);
+				else if (live[e.out[1]])
+					map[e.out[1]] = inner->gate_maj3(a, b, c);
+				continue;
+			default:
+				break;
+			}
 
-			(r ^ a ^ var ^ c).equal_to_const(false);
+			if (!live[e.out[0]])
+				continue;
 
-			r = var;
-			c = cn << 1;
+			switch (e.op) {
+			case OP_AND:
+				map[e.out[0]] = inner->gate_and(a, b);
+				break;
+			case OP_XOR:
+				map[e.out[0]] = inner->gate_xor(a, b);
+				break;
+			case OP_OR:
+				map[e.out[0]] = inner->gate_or(a, b);
+				break;
+			case OP_XOR3:
+				map[e.out[0]] = inner->gate_xor3(a, b, c);
+				break;
+			default:
+				map[e.out[0]] = inner->gate_maj3(a, b, c);
+				break;
+			}
 		}
-		return (r);
+		for (; next < num; next++) {
+			if (!gate[next])
+				map[next] = new_variable();
+		}
+		events.clear();
 	};
+};
 
-	var_t log() const {
-		var_t r;
-		var_t t = *this;
+static cone_sink_t cone_sink;
 
-		z[0].equal_to_const(true);
+/*
+ * Clause database used by -O to simplify the formula before it is
+ * written. It runs unit propagation, removes subsumed clauses and
+ * eliminates variables by resolution, when that does not increase
+ * the number of clauses. Frozen variables, which are needed to parse
+ * the solution, are never eliminated. Variables are not renumbered.
+ */
+class clause_db_t {
+	struct clause_t {
+		size_t off;
+		uint32_t size;
+		bool deleted;
+	};
+	std::vector<int> lits;
+	std::vector<clause_t> clauses;
+	std::vector<std::vector<uint32_t> > occ;	/* by literal */
+	std::vector<signed char> value;			/* by variable */
+	std::vector<char> mark;				/* by literal */
+	std::vector<int> units;
+	size_t nvar;
 
-		for (size_t x = 1; x != maxvar; x++) {
-			r.z[x] = t.z[x];
-			t = t + ((t & t.z[x]) << x);
+	static size_t index(int l) {
+		return (2 * (size_t)abs(l) + (l < 0));
+	};
+
+	bool contains(const clause_t &c, int l) const {
+		for (uint32_t x = 0; x != c.size; x++) {
+			if (lits[c.off + x] == l)
+				return (true);
 		}
-		return (r);
+		return (false);
 	};
 
-	var_t exp() const {
-		var_t r;
+	/* add a sorted clause without duplicate literals */
+	void add(const int *ptr, size_t n) {
+		const clause_t c = { lits.size(), (uint32_t)n, false };
 
-		z[0].equal_to_const(false);
+		if (n == 0)
+			conflict = true;
+		else if (n == 1)
+			units.push_back(ptr[0]);
 
-		r.z[0] = -zerovar;
+		lits.insert(lits.end(), ptr, ptr + n);
+		for (size_t x = 0; x != n; x++)
+			occ[index(ptr[x])].push_back(clauses.size());
+		clauses.push_back(c);
+	};
 
-		for (size_t x = 1; x != maxvar; x++)
-			r += (r & z[x]) << x;
-		return (r);
+	void remove(uint32_t ci) {
+		clauses[ci].deleted = true;
+		removed++;
 	};
 
-	var_t log_xor() const {
-		var_t r;
-		var_t t = *this;
+	/* remove literal "l" from a clause */
+	void strengthen(uint32_t ci, int l) {
+		clause_t &c = clauses[ci];
+		uint32_t y = 0;
 
-		z[0].equal_to_const(true);
+		for (uint32_t x = 0; x != c.size; x++) {
+			if (lits[c.off + x] != l)
+				lits[c.off + y++] = lits[c.off + x];
+		}
+		c.size = y;
+		strengthened++;
+
+		if (c.size == 0)
+			conflict = true;
+		else if (c.size == 1)
+			units.push_back(lits[c.off]);
+	};
+
+	void propagate(void) {
+		while (!units.empty() && !conflict) {
+			const int l = units.back();
+			units.pop_back();
+
+			if (value[abs(l)] != 0) {
+				if (value[abs(l)] != (l > 0 ? 1 : -1))
+					conflict = true;
+				continue;
+			}
+			value[abs(l)] = (l > 0) ? 1 : -1;
+
+			for (uint32_t ci : occ[index(l)]) {
+				if (!clauses[ci].deleted && contains(clauses[ci], l))
+					remove(ci);
+			}
+			for (uint32_t ci : occ[index(-l)]) {
+				if (!clauses[ci].deleted && contains(clauses[ci], -l))
+					strengthen(ci, -l);
+			}
+		}
+	};
+
+	/* check if the marked clause is a subset of clause "ci" */
+	bool subset(uint32_t ci, uint32_t size) const {
+		const clause_t &c = clauses[ci];
+		uint32_t found = 0;
+
+		for (uint32_t x = 0; x != c.size; x++)
+			found += mark[index(lits[c.off + x])];
+		return (found == size);
+	};
+
+	void subsume(void) {
+		std::vector<uint32_t> order;
+
+		for (uint32_t ci = 0; ci != clauses.size(); ci++) {
+			if (!clauses[ci].deleted && clauses[ci].size <= SUBSUME_CLAUSE_MAX)
+				order.push_back(ci);
+		}
+		std::stable_sort(order.begin(), order.end(),
+		    [this](uint32_t a, uint32_t b) {
+			return (clauses[a].size < clauses[b].size);
+		});
+
+		for (uint32_t ci : order) {
+			const clause_t &c = clauses[ci];
+			size_t best;
+
+			if (c.deleted)
+				continue;
+
+			/* search the shortest occurrence list */
+			best = index(lits[c.off]);
+			for (uint32_t x = 0; x != c.size; x++) {
+				const size_t i = index(lits[c.off + x]);
+				mark[i] = 1;
+				if (occ[i].size() < occ[best].size())
+					best = i;
+			}
+			for (uint32_t di : occ[best]) {
+				if (di != ci && !clauses[di].deleted &&
+				    clauses[di].size >= c.size && subset(di, c.size))
+					remove(di);
+			}
+			for (uint32_t x = 0; x != c.size; x++)
+				mark[index(lits[c.off + x])] = 0;
+		}
+	};
+
+	/* collect the live clauses containing "l" */
+	void live(int l, std::vector<uint32_t> &out) {
+		std::vector<uint32_t> &list = occ[index(l)];
+		size_t n = 0;
+
+		out.clear();
+		for (uint32_t ci : list) {
+			if (clauses[ci].deleted || !contains(clauses[ci], l))
+				continue;
+			list[n++] = ci;
+			out.push_back(ci);
+		}
+		list.resize(n);
+	};
+
+	/* compute the resolvent of two clauses on "v", false if tautology */
+	bool resolve(uint32_t pi, uint32_t ni, int v, std::vector<int> &out) const {
+		const clause_t &p = clauses[pi];
+		const clause_t &n = clauses[ni];
+
+		out.clear();
+		for (uint32_t x = 0; x != p.size; x++) {
+			if (lits[p.off + x] != v)
+				out.push_back(lits[p.off + x]);
+		}
+		for (uint32_t x = 0; x != n.size; x++) {
+			const int l = lits[n.off + x];
+			bool dup = false;
+
+			if (l == -v)
+				continue;
+			for (size_t y = 0; y != out.size(); y++) {
+				if (out[y] == -l)
+					return (false);
+				dup |= (out[y] == l);
+			}
+			if (!dup)
+				out.push_back(l);
+		}
+		std::sort(out.begin(), out.end());
+		return (true);
+	};
+
+	void eliminate(void) {
+		std::vector<uint32_t> pos;
+		std::vector<uint32_t> neg;
+		std::vector<int> temp;
+		std::vector<int> resolvents;
+		std::vector<size_t> sizes;
+		bool progress = true;
+
+		for (int round = 0; progress && !conflict && round != 4; round++) {
+			progress = false;
+
+			for (size_t v = 1; v != nvar && !conflict; v++) {
+				if (frozen[v] || value[v] != 0)
+					continue;
+
+				live(v, pos);
+				live(-(int)v, neg);
+
+				const size_t total = pos.size() + neg.size();
+				if (total == 0 || total > BVE_OCC_MAX)
+					continue;
+
+				resolvents.clear();
+				sizes.clear();
+
+				bool ok = true;
+				for (uint32_t pi : pos) {
+					for (uint32_t ni : neg) {
+						if (!resolve(pi, ni, v, temp))
+							continue;
+						if (temp.size() > BVE_CLAUSE_MAX ||
+						    sizes.size() == total) {
+							ok = false;
+							break;
+						}
+						resolvents.insert(resolvents.end(),
+						    temp.begin(), temp.end());
+						sizes.push_back(temp.size());
+					}
+					if (!ok)
+						break;
+				}
+				if (!ok)
+					continue;
+
+				for (uint32_t ci : pos)
+					remove(ci);
+				for (uint32_t ci : neg)
+					remove(ci);
+				for (size_t x = 0, off = 0; x != sizes.size(); off += sizes[x++])
+					add(&resolvents[off], sizes[x]);
+
+				eliminated++;
+				progress = true;
+				propagate();
+			}
+		}
+	};
+
+public:
+	bool conflict;
+	uintmax_t removed;
+	uintmax_t strengthened;
+	uintmax_t eliminated;
+
+	clause_db_t(const std::vector<int> &data, size_t num) {
+		std::vector<int> temp;
+
+		nvar = num;
+		conflict = false;
+		frozen.resize(nvar, 0);
+		frozen[zerovar] = 1;
+		removed = strengthened = eliminated = 0;
+		occ.resize(2 * nvar + 2);
+		value.assign(nvar, 0);
+		mark.assign(2 * nvar + 2, 0);
+
+		for (size_t x = 0, y; x != data.size(); x = y + 1) {
+			bool tautology = false;
+
+			for (y = x; data[y] != 0; y++)
+				;
+			temp.assign(data.begin() + x, data.begin() + y);
+			std::sort(temp.begin(), temp.end());
+			temp.erase(std::unique(temp.begin(), temp.end()), temp.end());
+			for (size_t z = 0; z != temp.size() && !tautology; z++)
+				tautology |= std::binary_search(temp.begin(), temp.end(), -temp[z]);
+			if (!tautology)
+				add(temp.data(), temp.size());
+		}
+	};
+
+	void run(void) {
+		propagate();
+		if (!conflict)
+			subsume();
+
+		/* without frozen variables, nothing may be eliminated */
+		for (size_t v = 1; v != nvar && !conflict; v++) {
+			if (v != (size_t)zerovar && frozen[v]) {
+				eliminate();
+				break;
+			}
+		}
+		if (!conflict)
+			subsume();
+	};
+
+	size_t count(void) const {
+		size_t n = 0;
+
+		if (conflict)
+			return (1);
+		for (size_t v = 1; v != nvar; v++)
+			n += (frozen[v] && value[v] != 0);
+		for (const clause_t &c : clauses)
+			n += !c.deleted;
+		return (n);
+	};
+
+	void emit(cnf_sink_t &other) const {
+		if (conflict) {
+			other.clause(NULL, 0);
+			return;
+		}
+
+		/* keep the value of frozen variables */
+		for (size_t v = 1; v != nvar; v++) {
+			if (frozen[v] && value[v] != 0) {
+				const int l = (value[v] > 0) ? (int)v : -(int)v;
+				other.clause(&l, 1);
+			}
+		}
+		for (const clause_t &c : clauses) {
+			if (!c.deleted)
+				other.clause(&lits[c.off], c.size);
+		}
+	};
+};
+
+/*
+ * Structural hashing of gates. Before a gate is built it is looked
+ * up by its operation and canonical operand pair, so that identical
+ * gates share a single variable. The table has a fixed size and uses
+ * open addressing within small buckets. When a bucket is full, an
+ * old entry is replaced. Repeated gates are usually built close to
+ * each other, so a table that stays in the CPU cache finds most of
+ * them. The table is cleared for every pass, because variable
+ * numbers are only valid within a pass.
+ */
+struct gate_hash_t {
+	uint64_t key;		/* zero means free */
+	int third;		/* zero for two input gates */
+	int op;
+	int value;
+};
+
+static gate_hash_t *gate_hash;
+static size_t gate_hash_size;
+static int gate_hash_bits = GATE_HASH_BITS;
+static uintmax_t gate_hash_lookups;
+static uintmax_t gate_hash_hits;
+
+static void
+gate_hash_reset(void)
+{
+	if (gate_hash_bits == 0)
+		return;
+
+	if (gate_hash == NULL) {
+		gate_hash_size = (size_t)1 << gate_hash_bits;
+		gate_hash = (gate_hash_t *)calloc(gate_hash_size, sizeof(gate_hash[0]));
+		if (gate_hash == NULL)
+			errx(EX_SOFTWARE, "Out of memory");
+	} else {
+		memset(gate_hash, 0, gate_hash_size * sizeof(gate_hash[0]));
+	}
+	gate_hash_lookups = 0;
+	gate_hash_hits = 0;
+}
+
+/* forget all gates, so that they are built again */
+static void
+gate_hash_flush(void)
+{
+	if (gate_hash != NULL)
+		memset(gate_hash, 0, gate_hash_size * sizeof(gate_hash[0]));
+}
+
+static int
+gate_build(int op, int a, int b, int c)
+{
+	switch (op) {
+	case OP_AND:
+		return (sink->gate_and(a, b));
+	case OP_XOR:
+		return (sink->gate_xor(a, b));
+	case OP_OR:
+		return (sink->gate_or(a, b));
+	case OP_XOR3:
+		return (sink->gate_xor3(a, b, c));
+	default:
+		return (sink->gate_maj3(a, b, c));
+	}
+}
+
+/*
+ * Bring the operands into canonical order. XOR gates only depend on
+ * the variables and not their polarity, so the signs are folded into
+ * the "inverted" flag. The third operand is zero for two input gates.
+ */
+static void
+gate_canonical(int op, int &a, int &b, int &c, bool &inverted)
+{
+	int t;
+
+	inverted = false;
+
+	if (op == OP_XOR || op == OP_XOR3) {
+		if (a < 0) {
+			a = -a;
+			inverted = !inverted;
+		}
+		if (b < 0) {
+			b = -b;
+			inverted = !inverted;
+		}
+		if (c < 0) {
+			c = -c;
+			inverted = !inverted;
+		}
+	}
+
+	/* all gates are commutative */
+	if (a > b) {
+		t = a;
+		a = b;
+		b = t;
+	}
+	if (c != 0 && b > c) {
+		t = b;
+		b = c;
+		c = t;
+		if (a > b) {
+			t = a;
+			a = b;
+			b = t;
+		}
+	}
+}
+
+/*
+ * Return the entry matching the given canonical gate, or else the
+ * entry which should be replaced by it. The entry given by "keep" is
+ * never replaced.
+ */
+static gate_hash_t *
+gate_hash_find(int op, int a, int b, int c, const gate_hash_t *keep = NULL)
+{
+	const uint64_t key = ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+	const uint64_t h = (key + (uint64_t)op * 0xD6E8FEB86659FD93ULL +
+	    (uint64_t)(uint32_t)c * 0xC2B2AE3D27D4EB4FULL) * 0x9E3779B97F4A7C15ULL;
+	gate_hash_t *bucket;
+	gate_hash_t *entry;
+
+	bucket = gate_hash + ((h >> (64 - gate_hash_bits)) & -(uint64_t)GATE_HASH_WAYS);
+
+	gate_hash_lookups++;
+
+	entry = NULL;
+	for (size_t x = 0; x != GATE_HASH_WAYS; x++) {
+		if (bucket[x].key == key && bucket[x].third == c &&
+		    bucket[x].op == op) {
+			gate_hash_hits++;
+			return (bucket + x);
+		} else if (bucket[x].key == 0 && entry == NULL &&
+		    bucket + x != keep) {
+			entry = bucket + x;
+		}
+	}
+	if (entry == NULL) {
+		entry = bucket + (gate_hash_lookups % GATE_HASH_WAYS);
+		if (entry == keep)
+			entry = bucket + ((gate_hash_lookups + 1) % GATE_HASH_WAYS);
+	}
+
+	entry->key = 0;
+	return (entry);
+}
+
+static void
+gate_hash_store(gate_hash_t *entry, int op, int a, int b, int c, int value)
+{
+	entry->key = ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+	entry->third = c;
+	entry->op = op;
+	entry->value = value;
+}
+
+static int
+gate_lookup(int op, int a, int b, int c = 0)
+{
+	gate_hash_t *entry;
+	bool inverted;
+	int value;
+
+	if (gate_hash == NULL)
+		return (gate_build(op, a, b, c));
+
+	gate_canonical(op, a, b, c, inverted);
+
+	entry = gate_hash_find(op, a, b, c);
+	if (entry->key != 0) {
+		value = entry->value;
+	} else {
+		value = gate_build(op, a, b, c);
+		gate_hash_store(entry, op, a, b, c, value);
+	}
+	return (inverted ? -value : value);
+}
+
+/*
+ * Build the sum and carry of three inputs together, which lets the
+ * sink share work between them. Both are looked up first, and only
+ * built when either one is missing.
+ */
+static void
+gate_lookup_add3(int a, int b, int c, int &sum, int &carry)
+{
+	gate_hash_t *es;
+	gate_hash_t *ec;
+	int sa = a, sb = b, sc = c;
+	int ca = a, cb = b, cc = c;
+	bool inverted;
+	bool dummy;
+
+	if (gate_hash == NULL) {
+		sink->gate_add3(a, b, c, sum, carry);
+		return;
+	}
+
+	gate_canonical(OP_XOR3, sa, sb, sc, inverted);
+	gate_canonical(OP_MAJ3, ca, cb, cc, dummy);
+
+	/* the sum and the carry may hash into the same bucket */
+	es = gate_hash_find(OP_XOR3, sa, sb, sc);
+	ec = gate_hash_find(OP_MAJ3, ca, cb, cc, es);
+
+	if (es->key != 0 && ec->key != 0) {
+		sum = inverted ? -es->value : es->value;
+		carry = ec->value;
+		return;
+	}
+
+	sink->gate_add3(a, b, c, sum, carry);
+
+	/* the sum is stored for positive inputs */
+	gate_hash_store(es, OP_XOR3, sa, sb, sc, inverted ? -sum : sum);
+	gate_hash_store(ec, OP_MAJ3, ca, cb, cc, carry);
+}
+
+class variable_t {
+public:
+	int v;
+	variable_t(void) {
+		v = zerovar;
+		assert(v != 0);
+	};
+	variable_t(int other) {
+		v = other;
+		assert(v != 0);
+	};
+	variable_t &operator =(int other) {
+		v = other;
+		assert(v != 0);
+		return (*this);
+	};
+	void toggleInverted(void);
+	bool isInverted(void);
+	void equal_to_const(bool) const;
+	void equal_to_var(const variable_t &other) const;
+
+	variable_t operator ~(void) const {
+		variable_t ret = -v;
+		assert(v != 0);
+		return (ret);
+	};
+	variable_t operator &(const variable_t &) const;
+	variable_t &operator &=(const variable_t &);
+	variable_t operator ^(const variable_t &) const;
+	variable_t &operator ^=(const variable_t &);
+	variable_t operator |(const variable_t &) const;
+	variable_t &operator |=(const variable_t &);
+};
+
+static variable_t xor3(const variable_t &, const variable_t &, const variable_t &);
+static variable_t maj3(const variable_t &, const variable_t &, const variable_t &);
+static void add3(const variable_t &, const variable_t &, const variable_t &,
+    variable_t &, variable_t &);
+
+class var_t;
+static var_t do_mul_fast(const var_t &, const var_t &, int);
+static var_t do_mul_const(const var_t &, const var_t &);
+static var_t do_mul_dadda(const var_t &, const var_t &);
+
+static void
+do_cnf_reset(void)
+{
+	/* the counting pass is replayed with output disabled */
+	if (prune && !cone_sink.empty()) {
+		const int saved = runs;
+		runs = 0;
+		cone_sink.replay();
+		runs = saved;
+		cone_gates = cone_kept = 0;
+	}
+
+	old_varnum = varnum;
+	old_nexpr = nexpr;
+	varnum = 1;
+	nexpr = 0;
+	zerovar = new_variable();
+
+	gate_hash_reset();
+	frozen.clear();
+	target_act.clear();
+	target_data.clear();
+	guard = 0;
+
+	/* hpRsat and XOR output do their own counting */
+	if (runs != 0 && (simplify || batch || cache))
+		sink = &memory_sink;
+	else if (runs != 0 || output_format == FORMAT_HPRSAT ||
+	    output_format == FORMAT_XCNF)
+		sink = output_sink();
+	else
+		sink = &count_sink;
+
+	sink->reset();
+
+	if (prune) {
+		cone_sink.reset();
+		cone_sink.inner = sink;
+		sink = &cone_sink;
+	}
+}
+
+static std::string
+do_cnf_header_line(int nvar, int nexp, int nlimit)
+{
+	std::ostringstream line;
+
+	if (output_format == FORMAT_HPRSAT)
+		line << comment << " " << nvar << " variables and " << nexp << " expressions";
+	else if (output_format == FORMAT_ICNF)
+		line << "p inccnf";
+	else if (varlimit)
+		line << "p cnf " << nvar << " " << nexp << " " << nlimit;
+	else
+		line << "p cnf " << nvar << " " << nexp;
+	return (line.str());
+}
+
+static void
+do_cnf_header(void)
+{
+	header_limit = varnum - 1;
+
+	if (output_format == FORMAT_COUNT || simplify || batch || cache) {
+		/* the header is output by do_cnf_finish() */
+	} else if (single_pass) {
+		/*
+		 * The final counts are not known yet. Reserve a
+		 * fixed width line, which is patched by do_cnf_finish().
+		 */
+		header_offset = output_base + outpos + outlen;
+		out_string(std::string(HEADER_WIDTH - 1, ' ') + "\n");
+	} else if (runs != 0) {
+		out_string(do_cnf_header_line(old_varnum - 1, old_nexpr, varnum - 1) + "\n");
+	}
+
+	if (output_format == FORMAT_HPRSAT) {
+		outcnf("v0\n");
+		outcnf("v1\n");
+	} else {
+		(variable_t(zerovar)).equal_to_const(false);
+	}
+}
+
+/* create an unnamed temporary file */
+static int
+spool_open(void)
+{
+	const char *tmpdir = getenv("TMPDIR");
+	std::string path = std::string(tmpdir ? tmpdir : "/tmp") + "/hpsat_generate.XXXXXX";
+	const int fd = mkstemp(&path[0]);
+
+	if (fd < 0)
+		err(EX_CANTCREAT, "Cannot create '%s'", path.c_str());
+	unlink(path.c_str());
+	return (fd);
+}
+
+/* copy the whole temporary file to another file */
+static off_t
+spool_copy(int from, int to)
+{
+	off_t total = 0;
+	ssize_t len;
+
+	if (lseek(from, 0, SEEK_SET) != 0)
+		err(EX_IOERR, "Cannot rewind spool file");
+	while ((len = read(from, outbuf, sizeof(outbuf))) > 0) {
+		out_write(to, outbuf, len);
+		total += len;
+	}
+	if (len < 0)
+		err(EX_IOERR, "Cannot read spool file");
+	return (total);
+}
+
+static void
+do_cnf_open(void)
+{
+	struct stat st;
+
+	if (batch || cache) {
+		/* the comments are copied into every file */
+		outfd = spool_open();
+	} else if (output_file != NULL) {
+		outfd = open(output_file, O_RDWR | O_CREAT | O_TRUNC, 0666);
+		if (outfd < 0)
+			err(EX_CANTCREAT, "Cannot open '%s'", output_file);
+	} else if (single_pass && do_parse == 0 && output_format != FORMAT_COUNT) {
+		/* patch standard output in place, if possible */
+		if (fstat(STDOUT_FILENO, &st) == 0 && S_ISREG(st.st_mode) &&
+		    (fcntl(STDOUT_FILENO, F_GETFL) & O_APPEND) == 0) {
+			output_base = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+			if (output_base >= 0)
+				return;
+			output_base = 0;
+		}
+
+		/* standard output may be a pipe, so spool to a temporary file */
+		outfd = spool_open();
+		output_spool = 1;
+	}
+}
+
+static void
+do_cnf_stats(void)
+{
+	struct timespec end_time;
+	double delta;
+
+	clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+	delta = (end_time.tv_sec - start_time.tv_sec) +
+	    (end_time.tv_nsec - start_time.tv_nsec) / 1000000000.0;
+	if (delta <= 0.0)
+		delta = 1.0 / 1000000000.0;
+
+	fprintf(stderr, "%s Wrote %d variables, %d expressions and %jd bytes in %.3f seconds\n"
+	    "%s Throughput %.1f MB/s, %.0f expressions/s\n",
+	    comment, varnum - 1, nexpr, (intmax_t)outpos, delta,
+	    comment, outpos / delta / 1000000.0, nexpr / delta);
+	fprintf(stderr, "%s Allocated %ju bit arrays using %ju memory chunks\n",
+	    comment, var_pool_allocs, var_pool_chunks);
+	fprintf(stderr, "%s Structural hashing: %ju lookups, %ju hits (%.1f%%)\n",
+	    comment, gate_hash_lookups, gate_hash_hits,
+	    gate_hash_lookups ? 100.0 * gate_hash_hits / gate_hash_lookups : 0.0);
+	if (prune) {
+		fprintf(stderr, "%s Cone of influence: kept %ju of %ju gates\n",
+		    comment, cone_kept, cone_gates);
+	}
+	if (cache_dir != NULL) {
+		fprintf(stderr, "%s Circuit cache: %ju hits, %ju misses\n",
+		    comment, cache_hits, cache_misses);
+	}
+}
+
+/*
+ * Simplify the clauses collected by the memory sink, and write them
+ * to the output sink, preceded by the CNF header.
+ */
+static void
+do_cnf_simplify(void)
+{
+	struct timespec t0, t1;
+	const int before = nexpr;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	clause_db_t db(memory_sink.data, varnum);
+	std::vector<int>().swap(memory_sink.data);
+	db.run();
+	nexpr = db.count();
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if (output_format != FORMAT_COUNT)
+		out_string(do_cnf_header_line(varnum - 1, nexpr, header_limit) + "\n");
+	db.emit(*static_cast<cnf_sink_t *>(output_sink()));
+
+	if (print_stats) {
+		fprintf(stderr, "%s Simplified %d into %d expressions in %.3f seconds\n"
+		    "%s Removed %ju and strengthened %ju clauses, eliminated %ju variables\n",
+		    comment, before, nexpr, (t1.tv_sec - t0.tv_sec) +
+		    (t1.tv_nsec - t0.tv_nsec) / 1000000000.0,
+		    comment, db.removed, db.strengthened, db.eliminated);
+	}
+}
+
+/* the -v value for comments, unless they serve several values */
+static std::string
+comment_value(void)
+{
+	if (shared_comments)
+		return ("v");
+	return (r_value.get_str());
+}
+
+/* a comment line with the values of a target, or the command line */
+static std::string
+values_comment(const std::string &what, const target_t &t)
+{
+	static const char *const name[3] = { "A", "B", "v" };
+	std::ostringstream line;
+
+	line << comment << " " << what << ":";
+	for (int x = 0; x != 3; x++) {
+		if (t.has[x])
+			line << " " << name[x] << "=" << t.value[x];
+		else if (target_base.has[x])
+			line << " " << name[x] << "=" << target_base.value[x];
+	}
+	return (line.str() + "\n");
+}
+
+/*
+ * Write one CNF file for every target in batch mode. The shared
+ * comments and clauses are formatted once, and copied into every
+ * file, followed by the values and the clauses of the target.
+ */
+static void
+do_batch_finish(void)
+{
+	const int comments = outfd;
+	size_t shared = 0;
+
+	out_flush();
+
+	for (size_t x = 0; x != memory_sink.data.size(); x++)
+		shared += (memory_sink.data[x] == 0);
+
+	outfd = spool_open();
+	memory_sink.replay(dimacs_sink);
+	out_flush();
+
+	const int body = outfd;
+
+	target_data.resize(targets.size());
+
+	for (size_t x = 0; x != targets.size(); x++) {
+		const std::string path = std::string(output_file) + "." + std::to_string(x);
+		memory_sink_t extra;
+		size_t n = shared;
+
+		extra.data.swap(target_data[x]);
+		for (size_t y = 0; y != extra.data.size(); y++)
+			n += (extra.data[y] == 0);
+
+		outfd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (outfd < 0)
+			err(EX_CANTCREAT, "Cannot open '%s'", path.c_str());
+
+		outpos += spool_copy(comments, outfd);
+		if (output_comments)
+			out_string(values_comment("target " + std::to_string(x), targets[x]));
+		out_string(do_cnf_header_line(varnum - 1, n, header_limit) + "\n");
+		out_flush();
+		outpos += spool_copy(body, outfd);
+		extra.replay(dimacs_sink);
+		out_flush();
+		close(outfd);
+	}
+
+	close(comments);
+	close(body);
+	outfd = STDOUT_FILENO;
+}
+
+/*
+ * The circuit cache of -K. An entry holds the CNF of one generator
+ * and its options, without the -A, -B and -v values: the literals
+ * holding the values are kept instead, and the value constraints are
+ * appended when the entry is output. When the circuit itself depends
+ * on the values, like for -C, the values are part of the key. The
+ * entry is a file named by the hash of its key, and holds this
+ * header, followed by the key, the comments, the literals of a, b
+ * and r, and the clauses in the binary format of -F binary.
+ */
+struct cache_header_t {
+	char magic[8];
+	uint64_t version;	/* hash of cache_build[] */
+	uint64_t key_len;
+	uint64_t comment_len;
+	uint64_t body_len;
+	uint32_t map_len[3];
+	int32_t zerovar;
+	int32_t varnum;
+	int32_t limit;
+	int32_t clauses;
+};
+
+static const char cache_magic[8] = "HPSATK1";
+
+/*
+ * Entries are only used by the generator which stored them. The build
+ * passes a hash of the source as SOURCE_HASH. Without it, the time of
+ * the build is used instead.
+ */
+#ifndef SOURCE_HASH
+#define	SOURCE_HASH __DATE__ " " __TIME__
+#endif
+static const char cache_build[] = "hpsat_generate " SOURCE_HASH;
+
+/* FNV-1a */
+static uint64_t
+cache_hash(const char *ptr, size_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	while (len--) {
+		hash ^= (uint8_t)*ptr++;
+		hash *= 0x100000001b3ULL;
+	}
+	return (hash);
+}
+
+static std::string
+cache_key(bool values)
+{
+	std::ostringstream key;
+
+	key << "f=" << function << " b=" << maxvar << " g=" << greater <<
+	    " r=" << rounded << " H=" << gate_hash_bits << " M=" << mul_engine <<
+	    " t=" << mul_threshold << " a=" << adder << " d=" << divider <<
+	    " e=" << card_encoder << " w=" << exp_window << " C=" << bind_constants;
+	if (has_m_value)
+		key << " m=" << m_value;
+	if (!weights.empty()) {
+		key << " W=";
+		for (size_t x = 0; x != weights.size(); x++)
+			key << (x ? "," : "") << weights[x];
+	}
+	if (inputexpr != NULL)
+		key << " i=" << inputexpr;
+	if (values) {
+		if (has_a_value)
+			key << " A=" << a_value;
+		if (has_b_value)
+			key << " B=" << b_value;
+		if (has_r_value)
+			key << " v=" << r_value;
+	}
+	return (key.str());
+}
+
+static std::string
+cache_path(const std::string &key)
+{
+	char name[20];
+
+	snprintf(name, sizeof(name), "/%016jx", (uintmax_t)cache_hash(key.data(), key.size()));
+	return (cache_dir + std::string(name));
+}
+
+/* decode clauses written by the binary sink */
+static void
+cache_replay(const uint8_t *ptr, size_t len, cnf_sink_t &other)
+{
+	std::vector<int> lits;
+	uint32_t u = 0;
+	unsigned shift = 0;
+
+	for (size_t x = 0; x != len; x++) {
+		if (ptr[x] == 0 && shift == 0) {
+			other.clause(lits.data(), lits.size());
+			lits.clear();
+			continue;
+		}
+		u |= (uint32_t)(ptr[x] & 0x7F) << shift;
+		if (ptr[x] & 0x80) {
+			shift += 7;
+			continue;
+		}
+		lits.push_back((u & 1) ? -(int)(u >> 1) : (int)(u >> 1));
+		u = 0;
+		shift = 0;
+	}
+}
+
+/* the same constraints as set_value(), returning their number */
+static int
+cache_set_value(cnf_sink_t *psink, const uint8_t *ptr, size_t len,
+    int zero, const mpz_class &value)
+{
+	int n = 0;
+
+	for (size_t z = 0; z != len; z++) {
+		const bool bit = (((value >> z) & 1) != 0);
+		int32_t v;
+
+		memcpy(&v, ptr + 4 * z, 4);
+		if (v == (bit ? -zero : zero))
+			continue;
+		if (psink != NULL)
+			psink->equal_to_const(v, bit);
+		n++;
+	}
+	return (n);
+}
+
+/*
+ * Output a cache entry, if it is valid and has the given key,
+ * followed by the constraints for the values. Else return false.
+ */
+static bool
+cache_output(const std::string &path, const std::string &key)
+{
+	const int fd = open(path.c_str(), O_RDONLY);
+	const mpz_class *value[3] = { &a_value, &b_value, &r_value };
+	const int has[3] = { has_a_value, has_b_value, has_r_value };
+	cache_header_t hdr;
+	struct stat st;
+	void *base;
+
+	if (fd < 0)
+		return (false);
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(hdr)) {
+		close(fd);
+		return (false);
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return (false);
+
+	const uint8_t *ptr = (const uint8_t *)base;
+
+	memcpy(&hdr, ptr, sizeof(hdr));
+
+	const uint64_t map_bytes = 4ULL * (hdr.map_len[0] + hdr.map_len[1] + hdr.map_len[2]);
+
+	/* entries of other versions, or other keys, are replaced */
+	if (memcmp(hdr.magic, cache_magic, sizeof(hdr.magic)) != 0 ||
+	    hdr.version != cache_hash(cache_build, sizeof(cache_build) - 1) ||
+	    hdr.key_len != key.size() ||
+	    sizeof(hdr) + hdr.key_len + hdr.comment_len + map_bytes +
+	    hdr.body_len != (uint64_t)st.st_size ||
+	    memcmp(ptr + sizeof(hdr), key.data(), key.size()) != 0) {
+		munmap(base, st.st_size);
+		return (false);
+	}
+
+	const uint8_t *comments = ptr + sizeof(hdr) + hdr.key_len;
+	const uint8_t *maps = comments + hdr.comment_len;
+	const uint8_t *body = maps + map_bytes;
+
+	if (output_file != NULL) {
+		outfd = open(output_file, O_RDWR | O_CREAT | O_TRUNC, 0666);
+		if (outfd < 0)
+			err(EX_CANTCREAT, "Cannot open '%s'", output_file);
+	} else {
+		outfd = STDOUT_FILENO;
+	}
+	outpos = 0;
+
+	varnum = hdr.varnum;
+	nexpr = hdr.clauses;
+	for (size_t x = 0, y = 0; x != 3; y += hdr.map_len[x++]) {
+		if (has[x]) {
+			nexpr += cache_set_value(NULL, maps + 4 * y,
+			    hdr.map_len[x], hdr.zerovar, *value[x]);
+		}
+	}
+
+	const int total = nexpr;
+
+	out_write(outfd, (const char *)comments, hdr.comment_len);
+	outpos += hdr.comment_len;
+
+	/* the cached comments do not show any values */
+	if (hdr.comment_len != 0 && (has_a_value || has_b_value || has_r_value))
+		out_string(values_comment("values", target_base));
+	out_string(do_cnf_header_line(varnum - 1, total, hdr.limit) + "\n");
+	cache_replay(body, hdr.body_len, dimacs_sink);
+	for (size_t x = 0, y = 0; x != 3; y += hdr.map_len[x++]) {
+		if (has[x]) {
+			cache_set_value(&dimacs_sink, maps + 4 * y,
+			    hdr.map_len[x], hdr.zerovar, *value[x]);
+		}
+	}
+	out_flush();
+	nexpr = total;
+
+	munmap(base, st.st_size);
+	if (outfd != STDOUT_FILENO)
+		close(outfd);
+	outfd = STDOUT_FILENO;
+	return (true);
+}
+
+/* look for the circuit in the cache, and output it when found */
+static bool
+cache_lookup(void)
+{
+	const std::string key = cache_key(cache_values);
+
+	if (cache_output(cache_path(key), key)) {
+		cache_hits++;
+		return (true);
+	}
+
+	/* the circuit may depend on the values */
+	if (cache_values == 0) {
+		const std::string vkey = cache_key(true);
+
+		if (cache_output(cache_path(vkey), vkey)) {
+			cache_hits++;
+			return (true);
+		}
+	}
+	cache_misses++;
+	return (false);
+}
+
+/*
+ * Store the circuit collected by the memory sink in the cache, and
+ * output it from there. The entry is written to a temporary file
+ * first, so that concurrent runs never see a partial entry.
+ */
+static void
+do_cache_finish(void)
+{
+	const int comments = outfd;
+	const std::string key = cache_key(cache_values);
+	const std::string path = cache_path(key);
+	std::string temp = path + ".XXXXXX";
+	cache_header_t hdr = {};
+	int fd;
+
+	out_flush();
+
+	if (mkdir(cache_dir, 0777) != 0 && errno != EEXIST)
+		err(EX_CANTCREAT, "Cannot create '%s'", cache_dir);
+	fd = mkstemp(&temp[0]);
+	if (fd < 0)
+		err(EX_CANTCREAT, "Cannot create '%s'", temp.c_str());
+
+	/* entries may be shared, so use the usual file mode */
+	const mode_t mask = umask(0);
+
+	umask(mask);
+	if (fchmod(fd, 0666 & ~mask) != 0)
+		err(EX_IOERR, "Cannot change mode of '%s'", temp.c_str());
+
+	memcpy(hdr.magic, cache_magic, sizeof(hdr.magic));
+	hdr.version = cache_hash(cache_build, sizeof(cache_build) - 1);
+	hdr.key_len = key.size();
+	hdr.zerovar = zerovar;
+	hdr.varnum = varnum;
+	hdr.limit = header_limit;
+	for (size_t x = 0; x != memory_sink.data.size(); x++)
+		hdr.clauses += (memory_sink.data[x] == 0);
+
+	/* the header is written last, when the sizes are known */
+	if (lseek(fd, sizeof(hdr), SEEK_SET) != (off_t)sizeof(hdr))
+		err(EX_IOERR, "Cannot seek '%s'", temp.c_str());
+	out_write(fd, key.data(), key.size());
+	hdr.comment_len = spool_copy(comments, fd);
+	for (size_t x = 0; x != 3; x++) {
+		hdr.map_len[x] = cache_map[x].size();
+		out_write(fd, (const char *)cache_map[x].data(), 4 * cache_map[x].size());
+	}
+
+	outfd = fd;
+	outpos = 0;
+	memory_sink.replay(binary_sink);
+	out_flush();
+	hdr.body_len = outpos;
+
+	if (pwrite(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr))
+		err(EX_IOERR, "Cannot write '%s'", temp.c_str());
+	close(fd);
+	close(comments);
+
+	if (rename(temp.c_str(), path.c_str()) != 0)
+		err(EX_CANTCREAT, "Cannot rename '%s'", temp.c_str());
+
+	std::vector<int>().swap(memory_sink.data);
+
+	if (cache_output(path, key) == false)
+		errx(EX_SOFTWARE, "Cannot read back '%s'", path.c_str());
+}
+
+static void
+do_cnf_finish(void)
+{
+	if (batch && do_parse == 0) {
+		do_batch_finish();
+		if (print_stats)
+			do_cnf_stats();
+		return;
+	}
+
+	if (cache) {
+		do_cache_finish();
+		if (print_stats)
+			do_cnf_stats();
+		return;
+	}
+
+	if (prune && do_parse == 0)
+		cone_sink.replay();
+	if (simplify && do_parse == 0)
+		do_cnf_simplify();
+
+	if (output_format == FORMAT_COUNT && do_parse == 0)
+		out_string(do_cnf_header_line(varnum - 1, nexpr, header_limit) + "\n");
+
+	/* one assumption cube for every target */
+	if (output_format == FORMAT_ICNF && do_parse == 0) {
+		if (target_act.empty())
+			out_string("a 0\n");
+		for (size_t x = 0; x != target_act.size(); x++) {
+			if (output_comments)
+				out_string(values_comment("target " + std::to_string(x), targets[x]));
+			out_string("a " + std::to_string(target_act[x]) + " 0\n");
+		}
+	}
+
+	out_flush();
+
+	if (header_offset >= 0) {
+		std::string line = do_cnf_header_line(varnum - 1, nexpr, header_limit);
+
+		if (line.size() >= HEADER_WIDTH)
+			errx(EX_SOFTWARE, "CNF header too long");
+		line.resize(HEADER_WIDTH - 1, ' ');
+
+		if (pwrite(outfd, line.data(), line.size(), header_offset) != (ssize_t)line.size())
+			err(EX_IOERR, "Cannot write CNF header");
+	}
+
+	/* copy spooled output to standard output */
+	if (output_spool)
+		spool_copy(outfd, STDOUT_FILENO);
+
+	if (print_stats)
+		do_cnf_stats();
+
+	if (outfd != STDOUT_FILENO)
+		close(outfd);
+}
+
+/*
+ * Pool allocator for the bit arrays of var_t. All bit arrays have the
+ * same size, so freed arrays are kept on a free list, and new arrays
+ * are carved out of large chunks. Chunks are never returned, which
+ * means the memory is recycled by every pass of the generators.
+ */
+static void *var_pool_free;
+static char *var_pool_ptr;
+static size_t var_pool_left;
+static size_t var_pool_size;
+
+static variable_t *
+var_pool_alloc(void)
+{
+	void *ptr;
+
+	var_pool_allocs++;
+
+	if (var_pool_free != NULL) {
+		ptr = var_pool_free;
+		var_pool_free = *(void **)ptr;
+		return ((variable_t *)ptr);
+	}
+
+	if (var_pool_left == 0) {
+		if (var_pool_size == 0) {
+			/* round up, to fit the free list pointer */
+			var_pool_size = maxvar * sizeof(variable_t);
+			var_pool_size += (-var_pool_size) % sizeof(void *);
+		}
+		var_pool_left = VAR_POOL_CHUNK / var_pool_size;
+		if (var_pool_left == 0)
+			var_pool_left = 1;
+		var_pool_ptr = (char *)malloc(var_pool_left * var_pool_size);
+		if (var_pool_ptr == NULL)
+			errx(EX_SOFTWARE, "Out of memory");
+		var_pool_chunks++;
+	}
+
+	assert(var_pool_size >= maxvar * sizeof(variable_t));
+
+	ptr = var_pool_ptr;
+	var_pool_ptr += var_pool_size;
+	var_pool_left--;
+	return ((variable_t *)ptr);
+}
+
+static void
+var_pool_release(variable_t *ptr)
+{
+	*(void **)ptr = var_pool_free;
+	var_pool_free = ptr;
+}
+
+static variable_t
+var_op(const variable_t &a, const variable_t &b, int op)
+{
+	switch (op) {
+	case OP_AND:
+		return (a & b);
+	case OP_XOR:
+		return (a ^ b);
+	default:
+		return (a | b);
+	}
+}
+
+class var_t {
+public:
+	variable_t *z;
+
+	/* check if all bits are constant */
+	bool is_const(void) const {
+		for (size_t x = 0; x != maxvar; x++) {
+			if (z[x].v != zerovar && z[x].v != -zerovar)
+				return (false);
+		}
+		return (true);
+	};
+
+	/* number of constant zero bits at the bottom */
+	size_t low(void) const {
+		size_t x;
+		for (x = 0; x != maxvar && z[x].v == zerovar; x++)
+			;
+		return (x);
+	};
+
+	/* start of the constant or sign-extended tail */
+	size_t width(void) const {
+		size_t x;
+		for (x = maxvar - 1; x != 0 && z[x - 1].v == z[x].v; x--)
+			;
+		return (x);
+	};
+
+	/*
+	 * Compute "a op b" into this variable, only emitting gates
+	 * for the live bit range. Bits where one operand is known
+	 * zero are passed through, and the common tail is computed
+	 * once and replicated. This variable may alias "a" or "b".
+	 */
+	void bitwise(const var_t &a, const var_t &b, int op) {
+		const size_t la = a.low();
+		const size_t lb = b.low();
+		const size_t ta = a.width();
+		const size_t tb = b.width();
+		const bool za = (a.z[maxvar - 1].v == zerovar);
+		const bool zb = (b.z[maxvar - 1].v == zerovar);
+		const size_t t = (ta > tb) ? ta : tb;
+
+		for (size_t x = 0; x <= t; x++) {
+			const bool a0 = (x < la || (za && x >= ta));
+			const bool b0 = (x < lb || (zb && x >= tb));
+
+			if (a0 || b0) {
+				if (op == OP_AND)
+					z[x] = zerovar;
+				else
+					z[x] = a0 ? b.z[x] : a.z[x];
+			} else {
+				z[x] = var_op(a.z[x], b.z[x], op);
+			}
+		}
+		for (size_t x = t + 1; x != maxvar; x++)
+			z[x] = z[t];
+	};
+
+	/* same as above, but with "b" repeated for every bit */
+	void bitwise(const var_t &a, const variable_t &b, int op) {
+		const size_t la = a.low();
+		const size_t ta = a.width();
+		const bool za = (a.z[maxvar - 1].v == zerovar);
+
+		for (size_t x = 0; x <= ta; x++) {
+			const bool a0 = (x < la || (za && x >= ta));
+
+			if (a0)
+				z[x] = (op == OP_AND) ? variable_t(zerovar) : b;
+			else
+				z[x] = var_op(a.z[x], b, op);
+		}
+		for (size_t x = ta + 1; x != maxvar; x++)
+			z[x] = z[ta];
+	};
+
+	var_t(void) {
+		z = var_pool_alloc();
+		for (size_t x = 0; x != maxvar; x++)
+			z[x].v = zerovar;
+	};
+
+	var_t(const variable_t &other) {
+		z = var_pool_alloc();
+		z[0] = other;
+		for (size_t x = 1; x != maxvar; x++)
+			z[x].v = zerovar;
+	};
+
+	var_t(const var_t &other) {
+		z = var_pool_alloc();
+
+		for (size_t x = 0; x != maxvar; x++)
+			z[x] = other.z[x];
+	};
+
+	var_t(var_t &&other) {
+		z = other.z;
+		other.z = NULL;
+	};
+
+	~var_t(void) {
+		if (z != NULL)
+			var_pool_release(z);
+	};
+
+	var_t &operator =(const var_t &other) {
+		if (&other != this) {
+			for (size_t x = 0; x != maxvar; x++)
+				z[x] = other.z[x];
+		}
+		return (*this);
+	};
+
+	var_t &operator =(var_t &&other) {
+		variable_t *ptr = z;
+
+		/* swap the bit arrays */
+		z = other.z;
+		other.z = ptr;
+		return (*this);
+	};
+
+	void alloc(size_t max = maxvar, bool is_signed = false) {
+		for (size_t x = 0; x != max; x++)
+			z[x].v = new_variable();
+		for (size_t x = max; x != maxvar; x++)
+			z[x].v = is_signed ? z[max - 1].v : zerovar;
+	};
+
+	void from_const(uint64_t var) {
+		for (size_t x = 0; x != maxvar; x++) {
+			if (x >= 64)
+				z[x] = zerovar;
+			else
+				z[x] = ((var >> x) & 1) ? -zerovar : zerovar;
+		}
+	};
+
+	void equal_to_const(bool other) const {
+		const int v = other ? -zerovar : zerovar;
+		const size_t t = width();
+
+		/* the tail only needs to be constrained once */
+		for (size_t x = 0; x <= t; x++) {
+			if (z[x].v != v)
+				z[x].equal_to_const(other);
+		}
+	};
+
+	void equal_to_var(const var_t &other) const {
+		const size_t ta = width();
+		const size_t tb = other.width();
+		const size_t t = (ta > tb) ? ta : tb;
+
+		for (size_t x = 0; x <= t; x++) {
+			if (z[x].v != other.z[x].v)
+				z[x].equal_to_var(other.z[x]);
+		}
+	};
+
+	var_t operator ~(void) const {
+		var_t r = *this;
+		for (size_t x = 0; x != maxvar; x++)
+			r.z[x] = ~r.z[x];
+		return (r);
+	};
+
+	var_t operator ^(const var_t &other) const & {
+		var_t c;
+		c.bitwise(*this, other, OP_XOR);
+		return (c);
+	};
+
+	var_t operator ^(const var_t &other) && {
+		*this ^= other;
+		return (std::move(*this));
+	};
+
+	var_t &operator ^=(const var_t &other) {
+		bitwise(*this, other, OP_XOR);
+		return (*this);
+	};
+
+	var_t operator ^(const variable_t &other) const & {
+		var_t c;
+		c.bitwise(*this, other, OP_XOR);
+		return (c);
+	};
+
+	var_t operator ^(const variable_t &other) && {
+		bitwise(*this, other, OP_XOR);
+		return (std::move(*this));
+	};
+
+	var_t operator &(const var_t &other) const & {
+		var_t c;
+		c.bitwise(*this, other, OP_AND);
+		return (c);
+	};
+
+	var_t operator &(const var_t &other) && {
+		*this &= other;
+		return (std::move(*this));
+	};
+
+	var_t &operator &=(const var_t &other) {
+		bitwise(*this, other, OP_AND);
+		return (*this);
+	};
+
+	var_t operator &(const variable_t &other) const & {
+		var_t c;
+		c.bitwise(*this, other, OP_AND);
+		return (c);
+	};
+
+	var_t operator &(const variable_t &other) && {
+		bitwise(*this, other, OP_AND);
+		return (std::move(*this));
+	};
+
+	var_t operator |(const var_t &other) const & {
+		var_t c;
+		c.bitwise(*this, other, OP_OR);
+		return (c);
+	};
+
+	var_t operator |(const var_t &other) && {
+		*this |= other;
+		return (std::move(*this));
+	};
+
+	var_t &operator |=(const var_t &other) {
+		bitwise(*this, other, OP_OR);
+		return (*this);
+	};
+
+	var_t operator |(const variable_t &other) const & {
+		var_t c;
+		c.bitwise(*this, other, OP_OR);
+		return (c);
+	};
+
+	var_t operator |(const variable_t &other) && {
+		bitwise(*this, other, OP_OR);
+		return (std::move(*this));
+	};
+
+	var_t operator <<(size_t shift) const & {
+		var_t c;
+		if (shift < maxvar) {
+			for (size_t x = 0; x != maxvar - shift; x++)
+				c.z[x + shift] = z[x];
+		}
+		return (c);
+	};
+
+	var_t operator <<(size_t shift) && {
+		*this <<= shift;
+		return (std::move(*this));
+	};
+
+	var_t &operator <<=(size_t shift) {
+		if (shift > maxvar)
+			shift = maxvar;
+		for (size_t x = maxvar; x-- != shift; )
+			z[x] = z[x - shift];
+		for (size_t x = 0; x != shift; x++)
+			z[x] = zerovar;
+		return (*this);
+	};
+
+	var_t operator >>(size_t shift) const & {
+		var_t c;
+		if (shift < maxvar) {
+			for (size_t x = shift; x != maxvar; x++)
+				c.z[x - shift] = z[x];
+		}
+		return (c);
+	};
+
+	var_t operator >>(size_t shift) && {
+		*this >>= shift;
+		return (std::move(*this));
+	};
+
+	var_t &operator >>=(size_t shift) {
+		if (shift > maxvar)
+			shift = maxvar;
+		for (size_t x = shift; x != maxvar; x++)
+			z[x - shift] = z[x];
+		for (size_t x = maxvar - shift; x != maxvar; x++)
+			z[x] = zerovar;
+		return (*this);
+	};
+
+	/* the bits above this are equal for all three operands */
+	size_t width(const var_t &b, const var_t &c) const {
+		return (std::max(width(), std::max(b.width(), c.width())));
+	};
+
+	var_t xor3(const var_t &b, const var_t &c) const {
+		const size_t t = width(b, c);
+		var_t r;
+		for (size_t x = 0; x <= t; x++)
+			r.z[x] = ::xor3(z[x], b.z[x], c.z[x]);
+		for (size_t x = t + 1; x != maxvar; x++)
+			r.z[x] = r.z[t];
+		return (r);
+	};
+
+	void add3(const var_t &b, const var_t &c, var_t &sum, var_t &carry) const {
+		const size_t t = width(b, c);
+		for (size_t x = 0; x <= t; x++)
+			::add3(z[x], b.z[x], c.z[x], sum.z[x], carry.z[x]);
+		for (size_t x = t + 1; x != maxvar; x++) {
+			sum.z[x] = sum.z[t];
+			carry.z[x] = carry.z[t];
+		}
+	};
+
+	/* combine the generate and propagate signals of two spans */
+	static void prefix_op(variable_t &g, variable_t &p,
+	    const variable_t &gl, const variable_t &pl) {
+		g = g | (p & gl);
+		p = p & pl;
+	};
+
+	/*
+	 * Compute the n bit sum of two values and a carry input using
+	 * the adder selected by -a. When n is less than the width, both
+	 * values must be zero above bit n, and the carry out is stored
+	 * in bit n. The prefix adders compute every carry as the
+	 * generate signal of the span below it, using a network of
+	 * logarithmic depth.
+	 */
+	var_t add_prefix(const var_t &other, const variable_t &cin, size_t n) const {
+		std::vector<variable_t> g(n);
+		std::vector<variable_t> p(n);
+		size_t d;
+		var_t r;
+
+		/* the carry input is generated below bit zero */
+		for (size_t x = 0; x != n; x++) {
+			if (x == 0 || adder == ADD_RIPPLE) {
+				g[x] = maj3(z[x], other.z[x], x ? g[x - 1] : cin);
+			} else {
+				g[x] = z[x] & other.z[x];
+				p[x] = z[x] ^ other.z[x];
+			}
+		}
+
+		switch (adder) {
+		case ADD_KOGGE_STONE:
+			for (d = 1; d < n; d *= 2) {
+				for (size_t x = n; x-- != d; )
+					prefix_op(g[x], p[x], g[x - d], p[x - d]);
+			}
+			break;
+		case ADD_BRENT_KUNG:
+			for (d = 1; 2 * d <= n; d *= 2) {
+				for (size_t x = 2 * d - 1; x < n; x += 2 * d)
+					prefix_op(g[x], p[x], g[x - d], p[x - d]);
+			}
+			for (; d != 0; d /= 2) {
+				for (size_t x = 3 * d - 1; x < n; x += 2 * d)
+					prefix_op(g[x], p[x], g[x - d], p[x - d]);
+			}
+			break;
+		case ADD_SKLANSKY:
+			for (d = 1; d < n; d *= 2) {
+				for (size_t x = d; x < n; x++) {
+					/* the top of the lower half of the block */
+					const size_t y = (x & ~(2 * d - 1)) + d - 1;
+
+					if (x & d)
+						prefix_op(g[x], p[x], g[y], p[y]);
+				}
+			}
+			break;
+		default:
+			break;
+		}
+
+		for (size_t x = 0; x != n; x++)
+			r.z[x] = ::xor3(z[x], other.z[x], x ? g[x - 1] : cin);
+		if (n < maxvar)
+			r.z[n] = (n != 0) ? g[n - 1] : cin;
+		return (r);
+	};
+
+	var_t operator +(const var_t &other) const {
+		const var_t &a = *this;
+		const var_t &b = other;
+		const size_t la = a.low();
+		const size_t lb = b.low();
+
+		if (la == maxvar)
+			return (b);
+		else if (lb == maxvar)
+			return (a);
+
+		const size_t l = (la > lb) ? la : lb;
+
+		/* low bits where one operand is zero need no carry */
+		if (l != 0) {
+			const var_t &p = (la > lb) ? b : a;
+			var_t c = ((a >> l) + (b >> l)) << l;
+
+			for (size_t x = 0; x != l; x++)
+				c.z[x] = p.z[x];
+			return (c);
+		}
+
+		var_t c;
+
+		/* the sum of two zero extended numbers is one bit wider */
+		if (a.z[maxvar - 1].v == zerovar && b.z[maxvar - 1].v == zerovar) {
+			const size_t ta = a.width();
+			const size_t tb = b.width();
+			const size_t t = ((ta > tb) ? ta : tb) + 1;
+
+			if (adder != ADD_SELASKY)
+				return (a.add_prefix(b, zerovar, t - 1));
+			c.alloc(t < maxvar ? t : maxvar);
+		} else {
+			if (adder != ADD_SELASKY)
+				return (a.add_prefix(b, zerovar, maxvar));
+			c.alloc();
+		}
+
+		/*
+		 * Build equation for addition after HP Selasky 2021:
+		 * a + b = c
+		 */
+		var_t t = (a ^ b);
+		var_t u = (a | b);
+
+		t.xor3(c, u << 1).equal_to_var((t & c) << 1);
+
+		return (c);
+	};
+
+	var_t &operator +=(const var_t &other) {
+		*this = *this + other;
+		return (*this);
+	};
+
+	var_t operator -(const var_t &other) const {
+		if (adder != ADD_SELASKY)
+			return (add_prefix(~other, -zerovar, maxvar));
+
+		var_t a;
+		const var_t &b = other;
+		const var_t &c = *this;
+
+		a.alloc();
+
+		/*
+		 * Build equation for addition after HP Selasky 2021:
+		 * a = c - b
+		 */
+		var_t t = (a ^ b);
+		var_t u = (a | b);
+
+		t.xor3(c, u << 1).equal_to_var((t & c) << 1);
+
+		return (a);
+	};
+
+	var_t &operator -=(const var_t &other) {
+		*this = *this - other;
+		return (*this);
+	};
+
+	var_t polar_add(const var_t &other) const {
+		var_t r;
+		r.alloc();
+
+		var_t s;
+		var_t c;
+
+		add3(other, r, s, c);
+
+		s.equal_to_var(c << 1);
+
+		return (r);
+	};
+
+	var_t polar_mul(const var_t &other) const {
+		var_t r;
+		var_t c;
+
+		for (size_t x = 0; x != maxvar; x++) {
+			const var_t a = (*this & other.z[x]) << x;
+
+			var_t var;
+			var.alloc();
+
+			var_t s;
+			var_t cn;
+
+			r.add3(a, var, s, cn);
+
+			s.equal_to_var(c);
+
+			r = std::move(var);
+			c = std::move(cn) << 1;
+		}
+		return (r);
+	};
+
+	var_t log() const {
+		var_t r;
+		var_t t = *this;
+
+		z[0].equal_to_const(true);
+
+		for (size_t x = 1; x != maxvar; x++) {
+			r.z[x] = t.z[x];
+			t += (t & t.z[x]) << x;
+		}
+		return (r);
+	};
+
+	var_t exp() const {
+		var_t r;
+
+		z[0].equal_to_const(false);
+
+		r.z[0] = -zerovar;
+
+		for (size_t x = 1; x != maxvar; x++)
+			r += (r & z[x]) << x;
+		return (r);
+	};
+
+	var_t log_xor() const {
+		var_t r;
+		var_t t = *this;
+
+		z[0].equal_to_const(true);
+
+		for (size_t x = 1; x != maxvar; x++) {
+			r.z[x] = t.z[x];
+			t ^= (t & t.z[x]) << x;
+		}
+		return (r);
+	};
+
+	var_t exp_xor() const {
+		var_t r;
+
+		z[0].equal_to_const(false);
+
+		r.z[0] = -zerovar;
+
+		for (size_t x = 1; x != maxvar; x++)
+			r ^= (r & z[x]) << x;
+		return (r);
+	};
+
+	var_t mul_xor(const var_t &other) const {
+		var_t r;
+		for (size_t x = 0; x != maxvar; x++) {
+			const var_t rol = (*this << x) ^ (*this >> (maxvar - x));
+			r ^= rol & other.z[x];
+		}
+		return (r);
+	};
+
+	var_t exp_xor(const var_t &other) const {
+		var_t base = *this;
+		var_t r;
+
+		r.from_const(1);
+
+		for (size_t x = 0; x != maxvar; x++) {
+			r = (r.mul_xor(base) & other.z[x]) ^ (r & ~other.z[x]);
+			base = base.mul_xor(base);
+		}
+		return (r);
+	};
+
+	var_t operator *(const var_t &other) const {
+		/* the Dadda tree already folds constant partial products */
+		if (mul_engine == MUL_DADDA)
+			return (do_mul_dadda(*this, other));
+		else if (other.is_const())
+			return (do_mul_const(*this, other));
+		else if (is_const())
+			return (do_mul_const(other, *this));
+		else if (mul_engine != MUL_SCHOOLBOOK)
+			return (do_mul_fast(*this, other, mul_engine));
+
+		var_t r;
+		for (size_t x = 0; x != maxvar; x++)
+			r += (*this & other.z[x]) << x;
+		return (r);
+	};
+
+	var_t &operator *=(const var_t &other) {
+		*this = *this * other;
+		return (*this);
+	};
+
+	var_t operator %(const var_t &other) const {
+		var_t r = *this;
+		for (size_t max = maxvar; max--; ) {
+			if (other.z[max].v != zerovar) {
+				for (size_t x = (maxvar - max); x--; ) {
+					var_t temp = (other << x);
+					r -= (temp & (temp >= r));
+				}
+				break;
+			}
+		}
+		return (r);
+	};
+
+	var_t &operator %=(const var_t &other) {
+		*this = *this % other;
+		return (*this);
+	};
+
+	/*
+	 * Compute the most significant bit of the difference, using
+	 * a chain of carries, a + ~b + 1, without building the other
+	 * bits of the difference.
+	 */
+	variable_t sub_sign(const var_t &other) const {
+		variable_t c = -zerovar;
+
+		for (size_t x = 0; x != maxvar - 1; x++)
+			c = maj3(z[x], ~other.z[x], c);
+		return (::xor3(z[maxvar - 1], ~other.z[maxvar - 1], c));
+	};
+
+	/*
+	 * Restoring division step, subtracting the other value if the
+	 * difference is not negative. A single borrow chain computes
+	 * both the difference and its sign. Returns true if the other
+	 * value was subtracted.
+	 */
+	variable_t sub_if_gte(const var_t &other) {
+		const size_t l = other.low();
+		variable_t c = -zerovar;
+		var_t d;
+
+		if (l == maxvar)
+			return (-zerovar);
+
+		for (size_t x = l; x != maxvar; x++) {
+			d.z[x] = ::xor3(z[x], ~other.z[x], c);
+			if (x != maxvar - 1)
+				c = maj3(z[x], ~other.z[x], c);
+		}
+
+		const variable_t gte = ~d.z[maxvar - 1];
+
+		for (size_t x = l; x != maxvar; x++)
+			z[x] = (d.z[x] & gte) | (z[x] & ~gte);
+		return (gte);
+	};
+
+	/*
+	 * Non-restoring division step, subtracting the other value if
+	 * "sub" is true and adding it otherwise, using a single carry
+	 * chain. Returns the sign of the result.
+	 */
+	variable_t add_sub(const var_t &other, const variable_t &sub) {
+		variable_t c = sub;
+
+		for (size_t x = other.low(); x != maxvar; x++) {
+			const variable_t y = other.z[x] ^ sub;
+			const variable_t t = ::xor3(z[x], y, c);
+
+			if (x != maxvar - 1)
+				c = maj3(z[x], y, c);
+			z[x] = t;
+		}
+		return (z[maxvar - 1]);
+	};
+
+	var_t unary_count(size_t) const;
+	var_t weighted_sum(const std::vector<mpz_class> &) const;
+	variable_t count_equal(size_t) const;
+
+	variable_t operator >(const var_t &other) {
+		return (other.sub_sign(*this));
+	};
+
+	variable_t operator >=(const var_t &other) {
+		return ~sub_sign(other);
+	};
+
+	variable_t operator <(const var_t &other) {
+		return (sub_sign(other));
+	};
+
+	variable_t operator <=(const var_t &other) {
+		return ~other.sub_sign(*this);
+	};
+};
+
+/*
+ * Helpers for the sub-quadratic multipliers. The value "w" is the
+ * number of result bits, and all bits above are constant zero.
+ */
+static var_t
+mul_trunc(const var_t &a, size_t w)
+{
+	var_t r = a;
+
+	for (size_t x = w; x < maxvar; x++)
+		r.z[x] = zerovar;
+	return (r);
+}
+
+static var_t
+mul_add(const var_t &a, const var_t &b, size_t w)
+{
+	return (mul_trunc(a + b, w));
+}
+
+/* compute (c - b) modulo 2**w, like operator-() */
+static var_t
+mul_sub(const var_t &c, const var_t &b, size_t w)
+{
+	var_t a;
+
+	a.alloc(w);
+
+	var_t t = (a ^ b);
+	var_t u = (a | b);
+	var_t e = t.xor3(c, u << 1);
+	var_t f = (t & c) << 1;
+
+	for (size_t x = 0; x != w; x++)
+		e.z[x].equal_to_var(f.z[x]);
+	return (a);
+}
+
+/* exact division by three, modulo 2**w */
+static var_t
+mul_div3(const var_t &a, size_t w)
+{
+	var_t q;
+
+	q.alloc(w);
+
+	var_t t = q + (q << 1);
+
+	for (size_t x = 0; x != w; x++)
+		t.z[x].equal_to_var(a.z[x]);
+	return (q);
+}
+
+/* exact division by two of a signed w bit value */
+static var_t
+mul_half(const var_t &a, size_t w)
+{
+	var_t r = a >> 1;
+
+	r.z[w - 1] = a.z[w - 1];
+	return (r);
+}
+
+/* negate a w bit value when "s" is set */
+static var_t
+mul_neg_if(const var_t &a, const variable_t &s, size_t w)
+{
+	return (mul_add(a ^ s, var_t(s), w));
+}
+
+static var_t do_mul_rec(const var_t &, const var_t &, size_t, size_t, int);
+
+/*
+ * Multiply two signed w bit values, using the magnitudes, which
+ * must fit into n bits.
+ */
+static var_t
+mul_signed(const var_t &a, const var_t &b, size_t n, size_t w)
+{
+	const variable_t sa = a.z[w - 1];
+	const variable_t sb = b.z[w - 1];
+	var_t ma = mul_trunc(mul_neg_if(a, sa, w), n);
+	var_t mb = mul_trunc(mul_neg_if(b, sb, w), n);
+
+	return (mul_neg_if(do_mul_rec(ma, mb, n, w, MUL_TOOM3), sa ^ sb, w));
+}
+
+static var_t
+do_mul_schoolbook(const var_t &a, const var_t &b, size_t n, size_t w)
+{
+	var_t r;
+
+	for (size_t x = 0; x != n && x != w; x++)
+		r = mul_add(r, (a & b.z[x]) << x, w);
+	return (r);
+}
+
+/*
+ * Karatsuba multiplication, splitting the n bit operands in two:
+ * a * b = z0 + (z1 << h) + (z2 << 2h), where z0 = a0 * b0,
+ * z2 = a1 * b1 and z1 = (a0 + a1) * (b0 + b1) - z0 - z2.
+ */
+static var_t
+do_mul_karatsuba(const var_t &a, const var_t &b, size_t n, size_t w, int engine)
+{
+	const size_t h = (n + 1) / 2;
+	const var_t a0 = mul_trunc(a, h);
+	const var_t b0 = mul_trunc(b, h);
+
+	if (w <= h)
+		return (do_mul_rec(a0, b0, h, w, engine));
+
+	const var_t a1 = a >> h;
+	const var_t b1 = b >> h;
+	const size_t w1 = std::min(w - h, 2 * h + 2);
+
+	var_t z0 = do_mul_rec(a0, b0, h, std::min(w, 2 * h), engine);
+	var_t z2 = do_mul_rec(a1, b1, n - h, std::min(w - h, 2 * (n - h)), engine);
+	var_t z1 = do_mul_rec(mul_add(a0, a1, h + 1), mul_add(b0, b1, h + 1),
+	    h + 1, w1, engine);
+
+	z1 = mul_sub(mul_sub(z1, mul_trunc(z0, w1), w1), mul_trunc(z2, w1), w1);
+
+	var_t r = mul_add(z0, z1 << h, w);
+	if (w > 2 * h)
+		r = mul_add(r, z2 << (2 * h), w);
+	return (r);
+}
+
+/*
+ * Toom-3 multiplication, splitting the n bit operands in three, and
+ * evaluating at 0, 1, -1, -2 and infinity. The interpolation follows
+ * Bodrato and Zanoni 2007. Intermediate values are signed and are
+ * computed exactly using W bits, which is enough for all of them.
+ */
+static var_t
+do_mul_toom3(const var_t &a, const var_t &b, size_t n, size_t w)
+{
+	const size_t k = (n + 2) / 3;
+	const size_t W = 2 * k + 8;
+	const var_t a0 = mul_trunc(a, k);
+	const var_t b0 = mul_trunc(b, k);
+
+	if (w <= k)
+		return (do_mul_rec(a0, b0, k, w, MUL_TOOM3));
+
+	const var_t a1 = mul_trunc(a >> k, k);
+	const var_t b1 = mul_trunc(b >> k, k);
+	const var_t a2 = a >> (2 * k);
+	const var_t b2 = b >> (2 * k);
+
+	/* evaluation */
+	const var_t ta = mul_add(a0, a2, W);
+	const var_t tb = mul_add(b0, b2, W);
+	const var_t pa1 = mul_add(ta, a1, W);
+	const var_t pb1 = mul_add(tb, b1, W);
+	const var_t pam1 = mul_sub(ta, a1, W);
+	const var_t pbm1 = mul_sub(tb, b1, W);
+	const var_t pam2 = mul_sub(mul_trunc(mul_add(pam1, a2, W) << 1, W), a0, W);
+	const var_t pbm2 = mul_sub(mul_trunc(mul_add(pbm1, b2, W) << 1, W), b0, W);
+
+	/* pointwise multiplication */
+	var_t r0 = do_mul_rec(a0, b0, k, 2 * k, MUL_TOOM3);
+	var_t r4 = do_mul_rec(a2, b2, n - 2 * k, 2 * (n - 2 * k), MUL_TOOM3);
+	var_t r1 = do_mul_rec(pa1, pb1, k + 2, 2 * k + 4, MUL_TOOM3);
+	var_t rm1 = mul_signed(pam1, pbm1, k + 1, W);
+	var_t rm2 = mul_signed(pam2, pbm2, k + 3, W);
+
+	/* interpolation */
+	var_t r3 = mul_div3(mul_sub(rm2, r1, W), W);
+	r1 = mul_half(mul_sub(r1, rm1, W), W);
+	var_t r2 = mul_sub(rm1, r0, W);
+	r3 = mul_add(mul_half(mul_sub(r2, r3, W), W), r4 << 1, W);
+	r2 = mul_sub(mul_add(r2, r1, W), r4, W);
+	r1 = mul_sub(r1, r3, W);
+
+	/* the coefficients are positive and below 2**(2k + 2) */
+	const var_t *coeff[5] = { &r0, &r1, &r2, &r3, &r4 };
+	var_t r;
+
+	for (size_t x = 0; x != 5 && x * k < w; x++)
+		r = mul_add(r, mul_trunc(*coeff[x], 2 * k + 2) << (x * k), w);
+	return (r);
+}
+
+/*
+ * Multiply two values below 2**n, keeping w bits of the product.
+ * The evaluation and interpolation of Toom-3 cost more than for
+ * Karatsuba, so it is only used for large operands.
+ */
+static var_t
+do_mul_rec(const var_t &a, const var_t &b, size_t n, size_t w, int engine)
+{
+	if (n <= mul_threshold || engine == MUL_SCHOOLBOOK)
+		return (do_mul_schoolbook(a, b, n, w));
+	else if (engine == MUL_TOOM3 && n > MUL_TOOM3_FACTOR * mul_threshold &&
+	    2 * ((n + 2) / 3) + 8 <= maxvar)
+		return (do_mul_toom3(a, b, n, w));
+	else
+		return (do_mul_karatsuba(a, b, n, w, engine));
+}
+
+/* size of a value, which is the full width unless zero extended */
+static size_t
+mul_width(const var_t &a)
+{
+	return ((a.z[maxvar - 1].v == zerovar) ? a.width() : maxvar);
+}
+
+/*
+ * Dadda tree. The bits in every column are compressed with full and
+ * half adders, until at most two bits are left in every column. The
+ * number of stages grows with the logarithm of the column height,
+ * and the two remaining rows are added last.
+ */
+static var_t
+do_dadda_sum(std::vector<std::vector<variable_t> > &col)
+{
+	std::vector<std::vector<variable_t> > next(maxvar);
+	std::vector<size_t> limit;
+	size_t height = 0;
+
+	for (size_t x = 0; x != maxvar; x++)
+		height = std::max(height, col[x].size());
+
+	/* the Dadda sequence of column heights: 2, 3, 4, 6, 9, 13, ... */
+	for (size_t d = 2; d < height; d = (3 * d) / 2)
+		limit.push_back(d);
+
+	while (!limit.empty()) {
+		const size_t d = limit.back();
+		limit.pop_back();
+
+		for (size_t x = 0; x != maxvar; x++) {
+			std::vector<variable_t> &in = col[x];
+			size_t y = 0;
+
+			while (in.size() - y + next[x].size() > d && in.size() - y >= 2) {
+				variable_t s;
+				variable_t c;
+
+				if (in.size() - y + next[x].size() == d + 1) {
+					s = in[y] ^ in[y + 1];
+					c = in[y] & in[y + 1];
+					y += 2;
+				} else if (in.size() - y >= 3) {
+					add3(in[y], in[y + 1], in[y + 2], s, c);
+					y += 3;
+				} else {
+					break;
+				}
+				next[x].push_back(s);
+				if (x + 1 != maxvar)
+					next[x + 1].push_back(c);
+			}
+			next[x].insert(next[x].end(), in.begin() + y, in.end());
+			in.clear();
+		}
+		col.swap(next);
+	}
+
+	var_t r0;
+	var_t r1;
+
+	for (size_t x = 0; x != maxvar; x++) {
+		if (col[x].size() > 0)
+			r0.z[x] = col[x][0];
+		if (col[x].size() > 1)
+			r1.z[x] = col[x][1];
+	}
+	return (r0 + r1);
+}
+
+/* Dadda tree multiplier, summing all partial products at once */
+static var_t
+do_mul_dadda(const var_t &a, const var_t &b)
+{
+	const size_t na = mul_width(a);
+	const size_t nb = mul_width(b);
+	std::vector<std::vector<variable_t> > col(maxvar);
+
+	for (size_t x = 0; x != na; x++) {
+		for (size_t y = 0; y != nb && x + y != maxvar; y++) {
+			const variable_t v = a.z[x] & b.z[y];
+
+			if (v.v != zerovar)
+				col[x + y].push_back(v);
+		}
+	}
+	return (do_dadda_sum(col));
+}
+
+/* merge two sorted lists of equal length, which is a power of two */
+static std::vector<variable_t>
+do_sort_merge(const std::vector<variable_t> &a, const std::vector<variable_t> &b)
+{
+	const size_t n = a.size();
+	std::vector<variable_t> r(2 * n);
+
+	if (n == 1) {
+		r[0] = a[0] | b[0];
+		r[1] = a[0] & b[0];
+		return (r);
+	}
+
+	std::vector<variable_t> ae(n / 2), ao(n / 2);
+	std::vector<variable_t> be(n / 2), bo(n / 2);
+
+	for (size_t x = 0; x != n / 2; x++) {
+		ae[x] = a[2 * x];
+		ao[x] = a[2 * x + 1];
+		be[x] = b[2 * x];
+		bo[x] = b[2 * x + 1];
+	}
+
+	const std::vector<variable_t> v = do_sort_merge(ae, be);
+	const std::vector<variable_t> w = do_sort_merge(ao, bo);
+
+	r[0] = v[0];
+	for (size_t x = 0; x != n - 1; x++) {
+		r[2 * x + 1] = w[x] | v[x + 1];
+		r[2 * x + 2] = w[x] & v[x + 1];
+	}
+	r[2 * n - 1] = w[n - 1];
+	return (r);
+}
+
+/*
+ * Sort bits in decreasing order, using odd-even merge sort. Only the
+ * first m bits of every sorted half are merged.
+ */
+static std::vector<variable_t>
+do_sort_bits(const variable_t *in, size_t n, size_t m)
+{
+	if (n == 1)
+		return (std::vector<variable_t>(in, in + 1));
+
+	std::vector<variable_t> a = do_sort_bits(in, n / 2, m);
+	std::vector<variable_t> b = do_sort_bits(in + n / 2, n - n / 2, m);
+	size_t p;
+
+	/* pad with zeros to a power of two */
+	for (p = 1; p < std::min(std::max(a.size(), b.size()), m); p *= 2)
+		;
+	a.resize(p, variable_t(zerovar));
+	b.resize(p, variable_t(zerovar));
+
+	std::vector<variable_t> r = do_sort_merge(a, b);
+
+	r.resize(std::min(r.size(), std::min(n, m)));
+	return (r);
+}
+
+/*
+ * Totalizer, counting the two halves in unary and merging them. Bit
+ * "x + y + 1" of the sum is set by bit "x" of one half and bit "y" of
+ * the other. Only the first m bits are computed.
+ */
+static std::vector<variable_t>
+do_totalizer(const variable_t *in, size_t n, size_t m)
+{
+	if (n == 1)
+		return (std::vector<variable_t>(in, in + 1));
+
+	const std::vector<variable_t> a = do_totalizer(in, n / 2, m);
+	const std::vector<variable_t> b = do_totalizer(in + n / 2, n - n / 2, m);
+	std::vector<variable_t> r(std::min(a.size() + b.size(), m), variable_t(zerovar));
+
+	for (size_t x = 0; x <= a.size(); x++) {
+		for (size_t y = 0; y <= b.size() && x + y <= r.size(); y++) {
+			if (x + y == 0)
+				continue;
+			else if (x == 0)
+				r[y - 1] |= b[y - 1];
+			else if (y == 0)
+				r[x - 1] |= a[x - 1];
+			else
+				r[x + y - 1] |= a[x - 1] & b[y - 1];
+		}
+	}
+	return (r);
+}
+
+/*
+ * Count the bits which are not constant zero in unary, using the
+ * encoder selected by -e. Bit "x" of the result is set when more than
+ * "x" bits are set. Only the first m bits are computed.
+ */
+var_t
+var_t :: unary_count(size_t m) const
+{
+	std::vector<variable_t> in;
+	std::vector<variable_t> out;
+	var_t r;
+
+	for (size_t x = 0; x != maxvar; x++) {
+		if (z[x].v != zerovar)
+			in.push_back(z[x]);
+	}
+	if (in.empty() || m == 0)
+		return (r);
+
+	switch (card_encoder) {
+	case CARD_SEQUENTIAL:
+		/* a chain of registers, one per counted value */
+		out.assign(std::min(in.size(), m), variable_t(zerovar));
+		for (size_t x = 0; x != in.size(); x++) {
+			for (size_t y = out.size(); y--; )
+				out[y] |= in[x] & (y ? out[y - 1] : variable_t(-zerovar));
+		}
+		break;
+	case CARD_SORTER:
+		out = do_sort_bits(&in[0], in.size(), m);
+		break;
+	default:
+		out = do_totalizer(&in[0], in.size(), m);
+		break;
+	}
+
+	for (size_t x = 0; x != out.size() && x != maxvar; x++)
+		r.z[x] = out[x];
+	return (r);
+}
+
+/*
+ * Compute the sum of the bits multiplied by the given weights, by
+ * putting every set bit of the weights into its column of a Dadda
+ * tree.
+ */
+var_t
+var_t :: weighted_sum(const std::vector<mpz_class> &w) const
+{
+	std::vector<std::vector<variable_t> > col(maxvar);
+
+	for (size_t x = 0; x != maxvar && x != w.size(); x++) {
+		for (size_t y = 0; y != maxvar; y++) {
+			if (((w[x] >> y) & 1) != 0 && z[x].v != zerovar)
+				col[y].push_back(z[x]);
+		}
+	}
+	return (do_dadda_sum(col));
+}
+
+/* check if the number of set bits is equal to k */
+variable_t
+var_t :: count_equal(size_t k) const
+{
+	if (k > maxvar)
+		return (zerovar);
+
+	if (card_encoder == CARD_ADDER) {
+		const var_t s = weighted_sum(std::vector<mpz_class>(maxvar, 1));
+		variable_t ne = zerovar;
+
+		for (size_t x = 0; x != maxvar; x++)
+			ne |= s.z[x] ^ variable_t(((k >> x) & 1) ? -zerovar : zerovar);
+		return (~ne);
+	}
+
+	const var_t u = unary_count(k + 1);
+
+	return ((k ? u.z[k - 1] : variable_t(-zerovar)) & ~(k < maxvar ? u.z[k] : variable_t(zerovar)));
+}
+
+/*
+ * Multiply by a constant, using a shift and add network. The constant
+ * is recoded into canonical signed digits, which have no two adjacent
+ * non-zero digits, so that runs of ones cost one addition and one
+ * subtraction. The number of adders is the number of non-zero digits
+ * minus one. The positive and negative digits are summed separately,
+ * while the partial sums are still narrow, and subtracted last.
+ */
+static var_t
+do_mul_const(const var_t &a, const var_t &k)
+{
+	std::vector<size_t> pos;
+	std::vector<size_t> neg;
+	bool carry = false;
+	var_t r;
+	var_t s;
+
+	for (size_t x = 0; x != maxvar; x++) {
+		const bool bit = (k.z[x].v == -zerovar);
+		const bool next = (x + 1 != maxvar && k.z[x + 1].v == -zerovar);
+
+		if (bit == carry) {
+			/* digit is zero, and the carry is kept */
+		} else if (next) {
+			neg.push_back(x);
+			carry = true;
+		} else {
+			pos.push_back(x);
+			carry = false;
+		}
+	}
+
+	for (size_t x = 0; x != pos.size(); x++)
+		r = x ? (r + (a << pos[x])) : (a << pos[x]);
+	for (size_t x = 0; x != neg.size(); x++)
+		s = x ? (s + (a << neg[x])) : (a << neg[x]);
+	return (neg.empty() ? r : (r - s));
+}
+
+static var_t
+do_mul_fast(const var_t &a, const var_t &b, int engine)
+{
+	const size_t n = std::max(mul_width(a), mul_width(b));
+
+	if (engine == MUL_DADDA)
+		return (do_mul_dadda(a, b));
+	else if (b.is_const())
+		return (do_mul_const(a, b));
+	else if (a.is_const())
+		return (do_mul_const(b, a));
+	return (do_mul_rec(a, b, n, maxvar, engine));
+}
+
+static void
+set_value(const var_t &f, mpz_class value)
+{
+	for (size_t z = 0; z != maxvar; z++) {
+		const bool bit = (((value >> z) & 1) != 0);
+
+		/* skip bits already bound to the right constant */
+		if (f.z[z].v != (bit ? -zerovar : zerovar))
+			f.z[z].equal_to_const(bit);
+	}
+}
+
+/* keep the literals of a value, for the cache of -K */
+static void
+cache_record(std::vector<int> &map, const var_t &f)
+{
+	map.resize(maxvar);
+	for (size_t z = 0; z != maxvar; z++)
+		map[z] = f.z[z].v;
+}
+
+static void
+bind_value(const var_t &f, mpz_class value, std::vector<int> &map)
+{
+	for (size_t z = 0; z != maxvar; z++) {
+		const int v = f.z[z].v;
+		const int c = (((value >> z) & 1) != 0) ? -zerovar : zerovar;
+
+		if (v == zerovar || v == -zerovar || map[abs(v)] != 0)
+			continue;
+		map[abs(v)] = (v < 0) ? -c : c;
+	}
+}
+
+static void
+bind_apply(const var_t &f, const std::vector<int> &map)
+{
+	for (size_t z = 0; z != maxvar; z++) {
+		const int v = f.z[z].v;
+
+		if (v == zerovar || v == -zerovar || map[abs(v)] == 0)
+			continue;
+		f.z[z] = (v < 0) ? -map[abs(v)] : map[abs(v)];
+	}
+}
+
+static void
+freeze_value(const var_t &f)
+{
+	for (size_t z = 0; z != maxvar; z++) {
+		const size_t v = abs(f.z[z].v);
+
+		if (frozen.size() <= v)
+			frozen.resize(v + 1, 0);
+		frozen[v] = 1;
+	}
+}
+
+static void
+target_apply(const target_t &t)
+{
+	if (t.has[0]) {
+		a_value = t.value[0];
+		has_a_value = 1;
+	}
+	if (t.has[1]) {
+		b_value = t.value[1];
+		has_b_value = 1;
+	}
+	if (t.has[2]) {
+		r_value = t.value[2];
+		has_r_value = 1;
+	}
+}
 
-		for (size_t x = 1; x != maxvar; x++) {
-			r.z[x] = t.z[x];
-			t = t ^ ((t & t.z[x]) << x);
-		}
-		return (r);
-	};
+/* check if any target replaces the given value */
+static bool
+target_sets(int which)
+{
+	for (size_t x = 0; x != targets.size(); x++) {
+		if (targets[x].has[which])
+			return (true);
+	}
+	return (false);
+}
 
-	var_t exp_xor() const {
-		var_t r;
+/*
+ * Loop over the targets, for the constraints depending on the -A, -B
+ * and -v values. Without targets, the loop body runs once. With
+ * -F icnf, the constraints are guarded by an activation literal for
+ * the target, which the solver assumes. In batch mode, they are
+ * collected separately for every target. Gates are not shared
+ * between targets, because their clauses only exist for one target.
+ */
+static bool
+target_next(size_t &x)
+{
+	/* the constraints are not the same for other values */
+	if (cache)
+		cache_values = 1;
 
-		z[0].equal_to_const(false);
+	if (targets.empty())
+		return (x++ == 0);
 
-		r.z[0] = -zerovar;
+	if (batch) {
+		if (x != 0)
+			memory_sink.data.swap(target_data[x - 1]);
+		gate_hash_flush();
+	}
 
-		for (size_t x = 1; x != maxvar; x++)
-			r ^= (r & z[x]) << x;
-		return (r);
-	};
+	/* restore the command line values */
+	a_value = target_base.value[0];
+	b_value = target_base.value[1];
+	r_value = target_base.value[2];
+	has_a_value = target_base.has[0];
+	has_b_value = target_base.has[1];
+	has_r_value = target_base.has[2];
+	guard = 0;
+
+	if (x == targets.size()) {
+		target_apply(targets[0]);
+		return (false);
+	}
 
-	var_t mul_xor(const var_t &other) const {
-		var_t r;
-		for (size_t x = 0; x != maxvar; x++) {
-			const var_t rol = (*this << x) ^ (*this >> (maxvar - x));
-			r = r ^ (rol & other.z[x]);
-		}
-		return (r);
-	};
+	target_apply(targets[x]);
 
-	var_t exp_xor(const var_t &other) const {
-		var_t base = *this;
-		var_t r;
+	if (batch) {
+		target_data.resize(targets.size());
+		memory_sink.data.swap(target_data[x]);
+	} else {
+		while (target_act.size() < targets.size())
+			target_act.push_back(new_variable());
+		guard = target_act[x];
+	}
+	x++;
+	return (true);
+}
 
-		r.from_const(1);
+/*
+ * Read targets for batch mode, one per line, from a file or standard
+ * input. A line lists values like "A=3 B=5 v=15", where a value
+ * without a name is for -v. Empty lines and lines starting with '#'
+ * are skipped.
+ */
+static void
+read_targets(const char *path)
+{
+	FILE *fp = (strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+	char *line = NULL;
+	size_t cap = 0;
 
-		for (size_t x = 0; x != maxvar; x++) {
-			r = (r.mul_xor(base) & other.z[x]) ^ (r & ~other.z[x]);
-			base = base.mul_xor(base);
-		}
-		return (r);
-	};
+	if (fp == NULL)
+		err(EX_NOINPUT, "Cannot open '%s'", path);
 
-	var_t operator *(const var_t &other) const {
-		var_t r;
-		for (size_t x = 0; x != maxvar; x++)
-			r = r + ((*this & other.z[x]) << x);
-		return (r);
-	};
+	while (getline(&line, &cap, fp) > 0) {
+		target_t t = {};
 
-	var_t &operator *=(const var_t &other) {
-		*this = *this * other;
-		return (*this);
-	};
+		if (line[0] == '#')
+			continue;
 
-	var_t operator %(const var_t &other) const {
-		var_t r = *this;
-		for (size_t max = maxvar; max--; ) {
-			if (other.z[max].v != zerovar) {
-				for (size_t x = (maxvar - max); x--; ) {
-					var_t temp = (other << x);
-					r -= (temp & (temp >= r));
-				}
-				break;
+		for (char *ptr = strtok(line, " \t\r\n"); ptr != NULL;
+		    ptr = strtok(NULL, " \t\r\n")) {
+			int which = 2;
+
+			if (ptr[0] != 0 && ptr[1] == '=') {
+				if (ptr[0] == 'A')
+					which = 0;
+				else if (ptr[0] == 'B')
+					which = 1;
+				else if (ptr[0] != 'v')
+					errx(EX_DATAERR, "Invalid target '%s'", ptr);
+				ptr += 2;
 			}
+			if (t.value[which].set_str(ptr, 10) != 0)
+				errx(EX_DATAERR, "Invalid target '%s'", ptr);
+			t.has[which] = true;
 		}
-		return (r);
-	};
-
-	var_t &operator %=(const var_t &other) {
-		*this = *this % other;
-		return (*this);
-	};
+		if (t.has[0] || t.has[1] || t.has[2])
+			targets.push_back(t);
+	}
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+}
 
-	variable_t operator >(const var_t &other) {
-		return (other - *this).z[maxvar - 1];
-	};
+/*
+ * Replace the variables of the operands given by -A, -B and -v with
+ * constant literals before the circuit is built, so that constant
+ * folding can remove the gates depending on them. Variables shared
+ * between the operands are replaced everywhere. Any conflicting bits
+ * are caught by set_values(), which only emits unit clauses for bits
+ * not already equal to the requested value.
+ *
+ * The operands are also frozen first, so that -O keeps the
+ * variables needed to parse the solution.
+ */
+static void
+bind_values(const var_t &a, const var_t &b, const var_t &r)
+{
+	freeze_value(a);
+	freeze_value(b);
+	freeze_value(r);
 
-	variable_t operator >=(const var_t &other) {
-		return ~(*this - other).z[maxvar - 1];
-	};
+	if (bind_constants == 0)
+		return;
 
-	variable_t operator <(const var_t &other) {
-		return (*this - other).z[maxvar - 1];
-	};
+	std::vector<int> map(varnum, 0);
 
-	variable_t operator <=(const var_t &other) {
-		return ~(other - *this).z[maxvar - 1];
-	};
-};
+	/* values changed by the targets are not constant */
+	if (has_a_value && target_sets(0) == false)
+		bind_value(a, a_value, map);
+	if (has_b_value && target_sets(1) == false)
+		bind_value(b, b_value, map);
+	if (has_r_value && target_sets(2) == false)
+		bind_value(r, r_value, map);
 
-static void
-set_value(const var_t &f, mpz_class value)
-{
-	for (size_t z = 0; z != maxvar; z++)
-		f.z[z].equal_to_const(((value >> z) & 1) != 0);
+	bind_apply(a, map);
+	bind_apply(b, map);
+	bind_apply(r, map);
 }
 
 static void
 set_values(const var_t &a, const var_t &b, const var_t &r)
 {
-	if (has_a_value)
+	/* the values are appended when the circuit is output */
+	if (cache) {
+		cache_record(cache_map[0], a);
+		cache_record(cache_map[1], b);
+		cache_record(cache_map[2], r);
+		return;
+	}
+
+	/* values not changed by the targets are shared */
+	if (has_a_value && target_sets(0) == false)
 		set_value(a, a_value);
-	if (has_b_value)
+	if (has_b_value && target_sets(1) == false)
 		set_value(b, b_value);
-	if (has_r_value)
+	if (has_r_value && target_sets(2) == false)
 		set_value(r, r_value);
+
+	for (size_t x = 0; target_next(x); ) {
+		if (has_a_value && target_sets(0))
+			set_value(a, a_value);
+		if (has_b_value && target_sets(1))
+			set_value(b, b_value);
+		if (has_r_value && target_sets(2))
+			set_value(r, r_value);
+	}
 }
 
 static ssize_t
@@ -609,52 +3928,12 @@ input_variables(mpz_class &v0, const var_t &x0,
 	return (-1);
 }
 
-static void
-out_triplet(int a, int b, int c)
-{
-	int array[3];
-	int t;
-
-	assert(a != 0);
-	assert(b != 0);
-	assert(c != 0);
-
-	array[0] = a;
-	array[1] = b;
-	array[2] = c;
-
-	for (a = 0; a != 3; a++) {
-		for (b = a + 1; b != 3; b++) {
-			if (array[a] > array[b]) {
-				t = array[b];
-				array[b] = array[a];
-				array[a] = t;
-			}
-		}
-	}
-
-	for (t = a = 0; a != 3; a++) {
-		if (array[a] != t) {
-			t = array[a];
-			outcnf(t << " ");
-		}
-	}
-	outcnf("0\n");
-	nexpr++;
-}
-
 void
 variable_t :: equal_to_const(bool value) const
 {
 	assert(v != 0);
 
-	if (output_format != 0) {
-		outvar(v); outcnf(" - " << value << "\n");
-		nexpr++;
-	} else {
-		outcnf((value ? v : -v) << " 0\n");
-		nexpr++;
-	}
+	sink->equal_to_const(v, value);
 }
 
 void
@@ -662,14 +3941,13 @@ variable_t :: equal_to_var(const variable_t &other) const
 {
 	assert(v != 0 && other.v != 0);
 
-	if (output_format != 0) {
-		outvar(v); outcnf(" - "); outvar(other.v); outcnf("\n");
-		nexpr++;
-	} else {
-		outcnf(-v << " " << other.v << " 0\n");
-		outcnf(v << " " << -other.v << " 0\n");
-		nexpr += 2;
-	}
+	/* equality with a constant is a unit clause */
+	if (other.v == zerovar || other.v == -zerovar)
+		sink->equal_to_const(v, other.v != zerovar);
+	else if (v == zerovar || v == -zerovar)
+		sink->equal_to_const(other.v, v != zerovar);
+	else
+		sink->equal_to_var(v, other.v);
 }
 
 void
@@ -699,40 +3977,16 @@ variable_t :: operator &(const variable_t &other) const
 	} else if (v == -other.v) {
 		/* inverted same variable */
 		return (zerovar);
-	} else if (output_format != 0) {
-		/*
-		 * Truth table:
-		 * a + b - 2 * c - d = 0
-		 */
-		const int c = new_variable();
-		const int d = new_variable();
-
-		outvar(v); outcnf(" + "); outvar(other.v); outcnf(" - 2 * "); outvar(c); outcnf(" - "); outvar(d); outcnf("\n");
-		nexpr++;
-
-		return (c);
+	} else if (v == zerovar || other.v == zerovar) {
+		/* AND with false */
+		return (zerovar);
+	} else if (v == -zerovar) {
+		/* AND with true */
+		return (other);
+	} else if (other.v == -zerovar) {
+		return (*this);
 	} else {
-		/*
-		 * Truth table:
-		 *
-		 * a v o  (a ^ v&o)
-		 * 0 0 0     0
-		 * 0 0 1     0
-		 * 0 1 0     0
-		 * 0 1 1     1
-		 * 1 0 0     1
-		 * 1 0 1     1
-		 * 1 1 0     1
-		 * 1 1 1     0
-		 */
-		const int a = new_variable();
-
-		out_triplet(a, -v, -other.v);
-		out_triplet(-a, v, other.v);
-		out_triplet(-a, v, -other.v);
-		out_triplet(-a, -v, other.v);
-
-		return (a);
+		return (gate_lookup(OP_AND, v, other.v));
 	}
 }
 
@@ -754,27 +4008,18 @@ variable_t :: operator ^(const variable_t &other) const
 	} else if (v == -other.v) {
 		/* inverted same variable */
 		return (-zerovar);
-	} else if (output_format != 0) {
-		/*
-		 * Truth table:
-		 * a + b - 2 * c - d = 0
-		 */
-		const int c = new_variable();
-		const int d = new_variable();
-
-		outvar(v); outcnf(" + "); outvar(other.v); outcnf(" + "); outvar(c); outcnf(" - 2 * "); outvar(d); outcnf("\n");
-		nexpr++;
-
-		return (c);
+	} else if (v == zerovar) {
+		/* XOR with false */
+		return (other);
+	} else if (other.v == zerovar) {
+		return (*this);
+	} else if (v == -zerovar) {
+		/* XOR with true */
+		return (~other);
+	} else if (other.v == -zerovar) {
+		return (~*this);
 	} else {
-		const int a = new_variable();
-
-		out_triplet(a, v, -other.v);
-		out_triplet(a, -v, other.v);
-		out_triplet(-a, v, other.v);
-		out_triplet(-a, -v, -other.v);
-
-		return (a);
+		return (gate_lookup(OP_XOR, v, other.v));
 	}
 }
 
@@ -797,21 +4042,16 @@ variable_t :: operator |(const variable_t &other) const
 	} else if (v == -other.v) {
 		/* inverted same variable */
 		return (-zerovar);
-	} else if (output_format != 0) {
-		/*
-		 * Truth table:
-		 * a | b = a ^ b ^ (a & b)
-		 */
-		return (*this ^ other ^ (*this & other));
+	} else if (v == -zerovar || other.v == -zerovar) {
+		/* OR with true */
+		return (-zerovar);
+	} else if (v == zerovar) {
+		/* OR with false */
+		return (other);
+	} else if (other.v == zerovar) {
+		return (*this);
 	} else {
-		const int a = new_variable();
-
-		out_triplet(a, v, -other.v);
-		out_triplet(a, -v, other.v);
-		out_triplet(a, -v, -other.v);
-		out_triplet(-a, v, other.v);
-
-		return (a);
+		return (gate_lookup(OP_OR, v, other.v));
 	}
 }
 
@@ -822,6 +4062,78 @@ variable_t :: operator |=(const variable_t &other)
 	return (*this);
 }
 
+/*
+ * Check if three inputs can be simplified, because one of them is
+ * constant or two of them share a variable.
+ */
+static bool
+is_foldable(int a, int b, int c)
+{
+	return (abs(a) == zerovar || abs(b) == zerovar || abs(c) == zerovar ||
+	    abs(a) == abs(b) || abs(a) == abs(c) || abs(b) == abs(c));
+}
+
+static variable_t
+xor3(const variable_t &a, const variable_t &b, const variable_t &c)
+{
+	assert(a.v != 0 && b.v != 0 && c.v != 0);
+
+	if (is_foldable(a.v, b.v, c.v))
+		return (a ^ b ^ c);
+	else
+		return (gate_lookup(OP_XOR3, a.v, b.v, c.v));
+}
+
+static variable_t
+maj3(const variable_t &a, const variable_t &b, const variable_t &c)
+{
+	assert(a.v != 0 && b.v != 0 && c.v != 0);
+
+	if (a.v == zerovar)
+		return (b & c);
+	else if (a.v == -zerovar)
+		return (b | c);
+	else if (b.v == zerovar)
+		return (a & c);
+	else if (b.v == -zerovar)
+		return (a | c);
+	else if (c.v == zerovar)
+		return (a & b);
+	else if (c.v == -zerovar)
+		return (a | b);
+	else if (a.v == b.v || a.v == c.v)
+		return (a);
+	else if (b.v == c.v)
+		return (b);
+	else if (a.v == -b.v)
+		return (c);
+	else if (a.v == -c.v)
+		return (b);
+	else if (b.v == -c.v)
+		return (a);
+	else
+		return (gate_lookup(OP_MAJ3, a.v, b.v, c.v));
+}
+
+/* full adder, the outputs may alias the inputs */
+static void
+add3(const variable_t &a, const variable_t &b, const variable_t &c,
+    variable_t &sum, variable_t &carry)
+{
+	int s;
+	int d;
+
+	if (is_foldable(a.v, b.v, c.v)) {
+		const variable_t t = xor3(a, b, c);
+		carry = maj3(a, b, c);
+		sum = t;
+	} else {
+		gate_lookup_add3(a.v, b.v, c.v, s, d);
+		sum = s;
+		carry = d;
+	}
+}
+
 static var_t
 do_add_full_v2(const var_t &a, const var_t &b, const var_t &z)
 {
@@ -834,8 +4146,7 @@ do_add_full_v2(const var_t &a, const var_t &b, const var_t &z)
 		if (x != 0)
 			carry = carry ^ z.z[x - 1];
 
-		r.z[x] = a.z[x] ^ b.z[x] ^ carry;
-		carry = (a.z[x] & b.z[x]) ^ (a.z[x] & carry) ^ (b.z[x] & carry);
+		add3(a.z[x], b.z[x], carry, r.z[x], carry);
 	}
 	return (r);
 }
@@ -846,8 +4157,7 @@ do_add_half_v1(const var_t &a, var_t &r, var_t &c, const var_t &z)
 	variable_t t[2];
 
 	for (size_t x = 0; x != maxvar; x++) {
-		t[0] = a.z[x] ^ r.z[x] ^ c.z[x];
-		t[1] = (a.z[x] & r.z[x]) ^ (a.z[x] & c.z[x]) ^ (r.z[x] & c.z[x]);
+		add3(a.z[x], r.z[x], c.z[x], t[0], t[1]);
 
 		r.z[x] = t[0];
 		c.z[x] = t[1];
@@ -890,27 +4200,10 @@ do_mul_half_v1(const variable_t &v0_0,
 	(v0_0 ^ v0_1 ^ (~v1_0 & v1_1)).equal_to_const(false);
 }
 
-static variable_t
-do_sub_if_gte(var_t &a, var_t &b, const var_t &value)
-{
-	var_t x;
-	var_t y;
-
-	x = a ^ b ^ value;
-	y = ((~a & b) | (~(a & ~b) & value)) << 1;
-
-	variable_t gte = (x >= y);
-
-	a = (x & gte) | (a & ~gte);
-	b = (y & gte) | (b & ~gte);
-
-	return (gte);
-}
-
 static void
 do_zero_mod_linear(var_t &rem, const var_t &hdiv)
 {
-	var_t sub;
+	variable_t neg = zerovar;
 	var_t tmp;
 	size_t max = (maxvar / 2);
 
@@ -922,11 +4215,109 @@ do_zero_mod_linear(var_t &rem, const var_t &hdiv)
 		for (size_t y = (x + max); y != maxvar; y++)
 			tmp.z[y] = zerovar;
 
-		do_sub_if_gte(rem, sub, tmp);
+		if (divider == DIV_RESTORING)
+			rem.sub_if_gte(tmp);
+		else
+			neg = rem.add_sub(tmp, ~neg);
+	}
+
+	/* restore a negative remainder */
+	if (divider != DIV_RESTORING)
+		rem.add_sub(hdiv & neg, zerovar);
+
+	/* result must be zero */
+	for (size_t x = 0; x != maxvar; x++)
+		rem.z[x].equal_to_const(false);
+}
+
+/*
+ * Montgomery multiplication, a * b * 2**-bits mod n, for a and b less
+ * than the odd modulus n. Each step adds the multiple of the modulus
+ * which clears the lowest bit, so that the sum can be halved, keeping
+ * it less than 2n.
+ */
+static var_t
+do_mont_mul(const var_t &a, const var_t &b, const var_t &n, size_t bits)
+{
+	var_t t;
+
+	for (size_t x = 0; x != bits; x++) {
+		t.add_sub(b & a.z[x], zerovar);
+		t.add_sub(n & t.z[0], zerovar);
+		t = t >> 1;
+	}
+	t.sub_if_gte(n);
+	return (t);
+}
+
+/* double a value less than n, modulo n, the given number of times */
+static var_t
+do_mod_double(const var_t &a, const var_t &n, size_t count)
+{
+	var_t r = a;
+
+	for (size_t x = 0; x != count; x++) {
+		r = r << 1;
+		r.sub_if_gte(n);
+	}
+	return (r);
+}
+
+/*
+ * Modular exponentiation, a**e mod n, for a less than the odd modulus
+ * n, using Montgomery multiplication. The exponent is scanned from the
+ * top in windows of bits. The powers of "a" for every window value
+ * are computed up front and selected by the exponent bits. Windows
+ * which are known to be zero skip the multiplication.
+ */
+static var_t
+do_mont_exp(const var_t &a, const var_t &e, const var_t &n, size_t bits, size_t window)
+{
+	const size_t nwin = (bits + window - 1) / window;
+	std::vector<var_t> table(1U << window);
+	var_t one;
+	var_t r2;
+	var_t r;
+
+	one.from_const(1);
+
+	/* 2**bits and 2**(2*bits) modulo n */
+	table[0] = do_mod_double(one, n, bits);
+	r2 = do_mod_double(table[0], n, bits);
+
+	/* convert into the Montgomery domain */
+	table[1] = do_mont_mul(a, r2, n, bits);
+	for (size_t x = 2; x != table.size(); x++)
+		table[x] = do_mont_mul(table[x - 1], table[1], n, bits);
+
+	for (size_t w = nwin; w--; ) {
+		std::vector<var_t> sel(table);
+		bool is_zero = true;
+
+		/* select the table entry using a tree of multiplexers */
+		for (size_t x = 0; x != window; x++) {
+			const size_t y = w * window + x;
+			const variable_t bit = (y < bits) ? e.z[y] : variable_t(zerovar);
+
+			if (bit.v != zerovar)
+				is_zero = false;
+			for (size_t z = 0; z != sel.size() / 2; z++)
+				sel[z] = (sel[2 * z] & ~bit) | (sel[2 * z + 1] & bit);
+			sel.resize(sel.size() / 2);
+		}
+
+		if (w == nwin - 1) {
+			r = sel[0];
+			continue;
+		}
+		for (size_t x = 0; x != window; x++)
+			r = do_mont_mul(r, r, n, bits);
+		if (is_zero == false)
+			r = do_mont_mul(r, sel[0], n, bits);
 	}
 
-	/* result must be zero */
-	rem.equal_to_var(sub);
+	/* convert back from the Montgomery domain */
+	return (do_mont_mul(r, one, n, bits));
 }
 
 static variable_t
@@ -1199,7 +4590,7 @@ generate_adder_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the addition of two " << maxvar << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit sum: (a + b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit sum: (a + b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -1211,6 +4602,8 @@ top:
 	b.alloc();
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -1245,7 +4638,7 @@ generate_mul_2adic_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the 2-adic multiplication of two " << (maxvar / 2) << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -1258,6 +4651,8 @@ top:
 	b.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -1292,7 +4687,7 @@ generate_mul_linear_v1_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the linear multiplication of two " << (maxvar / 2) << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -1304,6 +4699,8 @@ top:
 	b.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -1336,7 +4733,7 @@ generate_mul_linear_v2_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the linear multiplication of two " << (maxvar / 2) << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -1349,6 +4746,8 @@ top:
 	b.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -1383,7 +4782,7 @@ generate_mul_linear_v3_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the linear multiplication of two " << (maxvar / 2) << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -1395,6 +4794,8 @@ top:
 	b.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -1425,10 +4826,9 @@ top:
 static void
 generate_mul_linear_v4_cnf(void)
 {
-	mpz_class r_value_sqrt = sqrt(r_value);
 top:
 	outcnf(comment << " The following CNF computes the linear multiplication of two " << (maxvar / 2) << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -1442,6 +4842,8 @@ top:
 	b.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -1453,17 +4855,21 @@ top:
 		return;
 	}
 
-	for (size_t z = 0; z != maxvar; z++) {
+	for (size_t z = 0; z != maxvar; z++)
 		outcnf(comment << " Solution in " << a.z[z].v << " * " << b.z[z].v << " = " << f.z[z].v << "\n");
-		g.z[z].v = (((r_value_sqrt >> z) & 1) != 0) ? -zerovar : zerovar;
-	}
 
 	do_cnf_header();
 
 	if (greater)
 		(a > b).equal_to_const(false);
 
-	(a <= g).equal_to_const(true);
+	for (size_t x = 0; target_next(x); ) {
+		const mpz_class r_value_sqrt = sqrt(r_value);
+
+		for (size_t z = 0; z != maxvar; z++)
+			g.z[z].v = (((r_value_sqrt >> z) & 1) != 0) ? -zerovar : zerovar;
+		(a <= g).equal_to_const(true);
+	}
 
 	var_t r;
 
@@ -1483,7 +4889,7 @@ generate_mul_linear_v5_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the linear multiplication of two " << (maxvar / 2) << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -1496,6 +4902,8 @@ top:
 	b.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -1529,7 +4937,7 @@ generate_full_add_linear_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the full adition of two " << maxvar << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit sum: f(a, b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit sum: f(a, b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -1541,6 +4949,8 @@ top:
 	b.alloc();
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse == true) {
 		mpz_class va,vb,vf;
 
@@ -1569,10 +4979,9 @@ top:
 static void
 generate_mul_linear_limit_cnf(void)
 {
-	mpz_class r_value_sqrt = sqrt(r_value);
 top:
 	outcnf(comment << " The following CNF computes the linear multiplication of two " << (maxvar / 2) << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -1586,6 +4995,8 @@ top:
 	b.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -1600,13 +5011,16 @@ top:
 	for (size_t z = 0; z != maxvar; z++)
 		outcnf(comment << " Solution in " << a.z[z].v << " * " << b.z[z].v << " = " << f.z[z].v << "\n");
 
-	for (size_t z = 0; z != maxvar; z++)
-		g.z[z] = (((r_value_sqrt >> z) & 1) != 0) ? -zerovar : zerovar;
-
 	do_cnf_header();
 
-	(a <= g).equal_to_const(true);
-	(b >= g).equal_to_const(true);
+	for (size_t x = 0; target_next(x); ) {
+		const mpz_class r_value_sqrt = sqrt(r_value);
+
+		for (size_t z = 0; z != maxvar; z++)
+			g.z[z] = (((r_value_sqrt >> z) & 1) != 0) ? -zerovar : zerovar;
+		(a <= g).equal_to_const(true);
+		(b >= g).equal_to_const(true);
+	}
 	(b <= (f >> 1)).equal_to_const(true);
 
 	(a * b).equal_to_var(f);
@@ -1622,7 +5036,7 @@ generate_mul_linear_by_squaring_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the linear multiplication of two " << (maxvar / 2) << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit product: (a * a) - (b * b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit product: (a * a) - (b * b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -1635,6 +5049,8 @@ top:
 	b.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -1671,7 +5087,7 @@ generate_sqr_linear_cnf_v1(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the linear square root of a " << maxvar << " bit\n" <<
-	       comment << " variables into a " << (maxvar / 2) << " bit result: sqrt(a) = " << r_value << "\n");
+	       comment << " variables into a " << (maxvar / 2) << " bit result: sqrt(a) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -1682,6 +5098,8 @@ top:
 	a.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,var_t(),f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -1724,7 +5142,7 @@ generate_sqr_linear_cnf_v2(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the linear square root of a " << maxvar << " bit\n" <<
-	       comment << " variables into a " << (maxvar / 2) << " bit result: sqrt(a) = " << r_value << "\n");
+	       comment << " variables into a " << (maxvar / 2) << " bit result: sqrt(a) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -1735,6 +5153,8 @@ top:
 	a.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,var_t(),f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -1764,7 +5184,7 @@ generate_zero_mod_linear_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the linear modulus of two " << (maxvar / 2) << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit product: (a % b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit product: (a % b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -1774,6 +5194,8 @@ top:
 	a.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,var_t(),f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -1803,7 +5225,7 @@ generate_zero_mul_linear_cnf(bool isSquare)
 {
 top:
 	outcnf(comment << " The following CNF computes the linear multiplication of two " << (maxvar / 2) << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -1818,6 +5240,8 @@ top:
 		b.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -1872,8 +5296,10 @@ top:
 
 	c = (a & b);
 
-	if (has_r_value)
-		c.equal_to_const((r_value & 1) != 0);
+	if (has_r_value) {
+		for (size_t x = 0; target_next(x); )
+			c.equal_to_const((r_value & 1) != 0);
+	}
 
 	if (runs++ == 0)
 		goto top;
@@ -1909,8 +5335,10 @@ top:
 
 	c = (a | b);
 
-	if (has_r_value)
-		c.equal_to_const((r_value & 1) != 0);
+	if (has_r_value) {
+		for (size_t x = 0; target_next(x); )
+			c.equal_to_const((r_value & 1) != 0);
+	}
 
 	if (runs++ == 0)
 		goto top;
@@ -1946,8 +5374,10 @@ top:
 
 	c = (a ^ b);
 
-	if (has_r_value)
-		c.equal_to_const((r_value & 1) != 0);
+	if (has_r_value) {
+		for (size_t x = 0; target_next(x); )
+			c.equal_to_const((r_value & 1) != 0);
+	}
 
 	if (runs++ == 0)
 		goto top;
@@ -2122,12 +5552,11 @@ top:
 static void
 generate_div_linear_v1_cnf(bool isSquare)
 {
-	mpz_class r_value_sqrt = sqrt(r_value);
 top:
 	outcnf(comment << " The following CNF computes a divisor\n" <<
 	       comment << " having " << (maxvar / 2) << " bits for each variable and\n" <<
 	       comment << " having " << maxvar << " bits for the result.\n" <<
-	       comment << " The starting point for the division is " << r_value << "\n");
+	       comment << " The starting point for the division is " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -2144,6 +5573,8 @@ top:
 		b.alloc(maxvar / 2);
 	a.alloc();
 
+	bind_values(f,b,a);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -2158,15 +5589,18 @@ top:
 	for (size_t z = 0; z != maxvar; z++)
 		outcnf(comment << " Solution in " << a.z[z].v << " / " << b.z[z].v << " = " << f.z[z].v << "\n");
 
-	for (size_t z = 0; z != maxvar; z++)
-		g.z[z].v = (((r_value_sqrt >> z) & 1) != 0) ? -zerovar : zerovar;
-
 	do_cnf_header();
 
 	b.z[0].equal_to_const(1);
 
 	if (greater) {
-		(b <= g).equal_to_const(true);
+		for (size_t x = 0; target_next(x); ) {
+			const mpz_class r_value_sqrt = sqrt(r_value);
+
+			for (size_t z = 0; z != maxvar; z++)
+				g.z[z].v = (((r_value_sqrt >> z) & 1) != 0) ? -zerovar : zerovar;
+			(b <= g).equal_to_const(true);
+		}
 		(f > a).equal_to_const(false);
 	}
 
@@ -2175,7 +5609,9 @@ top:
 	for (size_t z = 0; z != (maxvar / 2); z++) {
 		variable_t bit = a.z[z];
 		f.z[z].equal_to_var(bit);
-		a -= (b << z) & bit;
+		/* the divisor is odd, so this bit is cleared without a borrow */
+		a.z[z] = zerovar;
+		a.add_sub(((b >> 1) << (z + 1)) & bit, -zerovar);
 	}
 
 	for (size_t z = 0; z != maxvar; z++)
@@ -2192,7 +5628,7 @@ top:
 	outcnf(comment << " The following CNF computes an inverse multiplier\n" <<
 	       comment << " having " << maxvar << " bits for each variable and\n" <<
 	       comment << " having " << maxvar << " bits for the result.\n" <<
-	       comment << " The starting point for the division is " << r_value << "\n");
+	       comment << " The starting point for the division is " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -2206,6 +5642,8 @@ top:
 	b.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -2265,7 +5703,7 @@ top:
 	outcnf(comment << " The following CNF computes an inverse multiplier\n" <<
 	       comment << " having " << maxvar << " bits for each variable and\n" <<
 	       comment << " having " << maxvar << " bits for the result.\n" <<
-	       comment << " The starting point for the division is " << r_value << "\n");
+	       comment << " The starting point for the division is " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -2279,6 +5717,8 @@ top:
 	b.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -2336,7 +5776,7 @@ generate_mul_2adic_rol_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the 2-adic rotating multiplication of two " << maxvar << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -2348,6 +5788,8 @@ top:
 	b.alloc(maxvar);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -2380,7 +5822,7 @@ generate_exp_2adic_rol_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the 2-adic rotating exponent of two " << maxvar << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit product: (a ** b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit product: (a ** b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -2392,6 +5834,8 @@ top:
 	b.alloc(maxvar);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -2424,7 +5868,7 @@ generate_polar_add_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the polar addition of two " << maxvar << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit sum: (a + b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit sum: (a + b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -2436,6 +5880,8 @@ top:
 	b.alloc();
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -2470,7 +5916,7 @@ generate_polar_mul_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the polar multiplication of two " << (maxvar / 2) << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit sum: (a * b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit sum: (a * b) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -2482,6 +5928,8 @@ top:
 	b.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -2516,7 +5964,7 @@ generate_log_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the logarithm of odd value \"a\" " << maxvar << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit result: log(a) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit result: log(a) = " << comment_value() << "\n");
 
 	do_cnf_reset();
 
@@ -2527,6 +5975,8 @@ top:
 	a.alloc(maxvar);
 	f.alloc();
 
+	bind_values(a,var_t(),f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
@@ -2556,42 +6006,273 @@ generate_dual_log_cnf(void)
 {
 top:
 	outcnf(comment << " The following CNF computes the logarithm of odd value \"a\" and \"b\" " << maxvar << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit result: log(a * b) = " << r_value << "\n");
+	       comment << " variables into a " << maxvar << " bit result: log(a * b) = " << comment_value() << "\n");
+
+	do_cnf_reset();
+
+	var_t a;
+	var_t b;
+	var_t c;
+	var_t d;
+	var_t f;
+	var_t e;
+
+	a.alloc();
+	b.alloc();
+	f.alloc();
+
+	bind_values(a,b,f);
+
+	if (do_parse) {
+		mpz_class va,vb,vf;
+
+		while (input_variables(va, a,
+				       vb, b,
+				       vf, f) == 0) {
+			std::cout << "log(" << va << " * " << vb << ") = " << vf << "\n";
+		}
+		return;
+	}
+
+	for (size_t z = 0; z != maxvar; z++)
+		outcnf(comment << " Solution in log(" << a.z[z].v << " * " << b.z[z].v << ") = " << f.z[z].v << "\n");
+
+	do_cnf_header();
+
+	c = a.log();
+	d = b.log();
+
+	(c & d).equal_to_const(false);
+	(c ^ d).equal_to_var(f);
+
+	set_values(a,b,f);
+
+	if (runs++ == 0)
+		goto top;
+}
+
+static void
+generate_exp_cnf(void)
+{
+top:
+	outcnf(comment << " The following CNF computes the exponent of even value \"a\" " << maxvar << " bit\n" <<
+	       comment << " variables into a " << maxvar << " bit result: exp(a) = " << comment_value() << "\n");
+
+	do_cnf_reset();
+
+	var_t a;
+	var_t f;
+	var_t e;
+
+	a.alloc(maxvar);
+	f.alloc();
+
+	bind_values(a,var_t(),f);
+
+	if (do_parse) {
+		mpz_class va,vb,vf;
+
+		while (input_variables(va, a,
+				       vb, var_t(),
+				       vf, f) == 0) {
+			std::cout << "exp(" << va << ") = " << vf << "\n";
+		}
+		return;
+	}
+
+	for (size_t z = 0; z != maxvar; z++)
+		outcnf(comment << " Solution in exp(" << a.z[z].v << ") = " << f.z[z].v << "\n");
+
+	do_cnf_header();
+
+	a.exp().equal_to_var(f);
+
+	set_values(a,var_t(),f);
+
+	if (runs++ == 0)
+		goto top;
+}
+
+static void
+generate_log_xor_cnf(void)
+{
+top:
+	outcnf(comment << " The following CNF computes the XOR logarithm of odd value \"a\" " << maxvar << " bit\n" <<
+	       comment << " variables into a " << maxvar << " bit result: log_xor(a) = " << comment_value() << "\n");
+
+	do_cnf_reset();
+
+	var_t a;
+	var_t f;
+	var_t e;
+
+	a.alloc(maxvar);
+	f.alloc();
+
+	bind_values(a,var_t(),f);
+
+	if (do_parse) {
+		mpz_class va,vb,vf;
+
+		while (input_variables(va, a,
+				       vb, var_t(),
+				       vf, f) == 0) {
+			std::cout << "log_xor(" << va << ") = " << vf << "\n";
+		}
+		return;
+	}
+
+	for (size_t z = 0; z != maxvar; z++)
+		outcnf(comment << " Solution in log_xor(" << a.z[z].v << ") = " << f.z[z].v << "\n");
+
+	do_cnf_header();
+
+	a.log_xor().equal_to_var(f);
+
+	set_values(a,var_t(),f);
+
+	if (runs++ == 0)
+		goto top;
+}
+
+static void
+generate_dual_log_xor_cnf(void)
+{
+top:
+	outcnf(comment << " The following CNF computes the XOR logarithm of odd value \"a\" and \"b\" " << maxvar << " bit\n" <<
+	       comment << " variables into a " << maxvar << " bit result: log_xor(a * b) = " << comment_value() << "\n");
+
+	do_cnf_reset();
+
+	var_t a;
+	var_t b;
+	var_t c;
+	var_t d;
+	var_t f;
+	var_t e;
+
+	a.alloc();
+	b.alloc();
+	f.alloc();
+
+	bind_values(a,b,f);
+
+	if (do_parse) {
+		mpz_class va,vb,vf;
+
+		while (input_variables(va, a,
+				       vb, b,
+				       vf, f) == 0) {
+			std::cout << "log_xor(" << va << " * " << vb << ") = " << vf << "\n";
+		}
+		return;
+	}
+
+	for (size_t z = 0; z != maxvar; z++)
+		outcnf(comment << " Solution in log_xor(" << a.z[z].v << " * " << b.z[z].v << ") = " << f.z[z].v << "\n");
+
+	do_cnf_header();
+
+	c = a.log_xor();
+	d = b.log_xor();
+
+	(c & d).equal_to_const(false);
+	(c ^ d).equal_to_var(f);
+
+	set_values(a,b,f);
+
+	if (runs++ == 0)
+		goto top;
+}
+
+static void
+generate_exp_xor_cnf(void)
+{
+top:
+	outcnf(comment << " The following CNF computes the XOR exponent of even value \"a\" " << maxvar << " bit\n" <<
+	       comment << " variables into a " << maxvar << " bit result: exp_xor(a) = " << comment_value() << "\n");
+
+	do_cnf_reset();
+
+	var_t a;
+	var_t f;
+	var_t e;
+
+	a.alloc(maxvar);
+	f.alloc();
+
+	bind_values(a,var_t(),f);
+
+	if (do_parse) {
+		mpz_class va,vb,vf;
+
+		while (input_variables(va, a,
+				       vb, var_t(),
+				       vf, f) == 0) {
+			std::cout << "exp_xor(" << va << ") = " << vf << "\n";
+		}
+		return;
+	}
+
+	for (size_t z = 0; z != maxvar; z++)
+		outcnf(comment << " Solution in exp_xor(" << a.z[z].v << ") = " << f.z[z].v << "\n");
+
+	do_cnf_header();
+
+	a.exp_xor().equal_to_var(f);
+
+	set_values(a,var_t(),f);
+
+	if (runs++ == 0)
+		goto top;
+}
+
+static void
+generate_mul_linear_fast_cnf(int engine)
+{
+top:
+	outcnf(comment << " The following CNF computes the linear multiplication of two " << (maxvar / 2) << " bit\n" <<
+	       comment << " variables into a " << maxvar << " bit product: (a * b) = " << comment_value() << "\n");
+
+	if (engine == MUL_DADDA) {
+		outcnf(comment << " using a Dadda tree multiplier\n");
+	} else {
+		outcnf(comment << " using " << (engine == MUL_TOOM3 ? "Toom-3" : "Karatsuba") <<
+		       " multiplication down to " << mul_threshold << " bits\n");
+	}
 
 	do_cnf_reset();
 
 	var_t a;
 	var_t b;
-	var_t c;
-	var_t d;
 	var_t f;
-	var_t e;
 
-	a.alloc();
-	b.alloc();
+	a.alloc(maxvar / 2);
+	b.alloc(maxvar / 2);
 	f.alloc();
 
+	bind_values(a,b,f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
 		while (input_variables(va, a,
 				       vb, b,
 				       vf, f) == 0) {
-			std::cout << "log(" << va << " * " << vb << ") = " << vf << "\n";
+			std::cout << va << " * " << vb << " = " << vf << "\n";
 		}
 		return;
 	}
 
 	for (size_t z = 0; z != maxvar; z++)
-		outcnf(comment << " Solution in log(" << a.z[z].v << " * " << b.z[z].v << ") = " << f.z[z].v << "\n");
+		outcnf(comment << " Solution in " << a.z[z].v << " * " << b.z[z].v << " = " << f.z[z].v << "\n");
 
 	do_cnf_header();
 
-	c = a.log();
-	d = b.log();
+	if (greater)
+		(a > b).equal_to_const(false);
 
-	(c & d).equal_to_const(false);
-	(c ^ d).equal_to_var(f);
+	do_mul_fast(a, b, engine).equal_to_var(f);
 
 	set_values(a,b,f);
 
@@ -2599,167 +6280,254 @@ top:
 		goto top;
 }
 
+/* the modulus given by -m, or an odd variable */
 static void
-generate_exp_cnf(void)
+mont_modulus(var_t &n, size_t bits)
+{
+	if (has_m_value == 0) {
+		n.alloc(bits);
+		return;
+	}
+	if (m_value >= (mpz_class(1) << bits))
+		errx(EX_USAGE, "Modulus does not fit in %zu bits", bits);
+
+	for (size_t z = 0; z != maxvar; z++)
+		n.z[z].v = (((m_value >> z) & 1) != 0) ? -zerovar : zerovar;
+}
+
+static void
+generate_mont_mul_cnf(void)
 {
+	const size_t bits = maxvar / 2;
 top:
-	outcnf(comment << " The following CNF computes the exponent of even value \"a\" " << maxvar << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit result: exp(a) = " << r_value << "\n");
+	outcnf(comment << " The following CNF computes the Montgomery multiplication of two " << bits << " bit\n" <<
+	       comment << " variables: (a * b / 2**" << bits << ") mod n = " << comment_value() << "\n");
+	if (has_m_value)
+		outcnf(comment << " using the fixed modulus " << m_value << "\n");
 
 	do_cnf_reset();
 
 	var_t a;
+	var_t b;
+	var_t n;
+	var_t bn;
 	var_t f;
-	var_t e;
 
-	a.alloc(maxvar);
-	f.alloc();
+	a.alloc(bits);
+	b.alloc(bits);
+	mont_modulus(n, bits);
+	f.alloc(bits);
+
+	bind_values(a,b,f);
+	freeze_value(n);
+
+	/* the modulus is parsed together with "b" */
+	for (size_t z = 0; z != bits; z++) {
+		bn.z[z] = b.z[z];
+		bn.z[z + bits] = n.z[z];
+	}
 
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
 		while (input_variables(va, a,
-				       vb, var_t(),
+				       vb, bn,
 				       vf, f) == 0) {
-			std::cout << "exp(" << va << ") = " << vf << "\n";
+			std::cout << va << " * " << (vb & ((mpz_class(1) << bits) - 1)) <<
+			    " / 2**" << bits << " mod " << (vb >> bits) << " = " << vf << "\n";
 		}
 		return;
 	}
 
 	for (size_t z = 0; z != maxvar; z++)
-		outcnf(comment << " Solution in exp(" << a.z[z].v << ") = " << f.z[z].v << "\n");
+		outcnf(comment << " Solution in " << a.z[z].v << " * " << b.z[z].v << " mod " << n.z[z].v << " = " << f.z[z].v << "\n");
 
 	do_cnf_header();
 
-	a.exp().equal_to_var(f);
+	if (has_m_value == 0)
+		n.z[0].equal_to_const(1);
+	(a < n).equal_to_const(true);
+	(b < n).equal_to_const(true);
 
-	set_values(a,var_t(),f);
+	if (greater)
+		(a > b).equal_to_const(false);
+
+	do_mont_mul(a, b, n, bits).equal_to_var(f);
+
+	set_values(a,b,f);
 
 	if (runs++ == 0)
 		goto top;
 }
 
 static void
-generate_log_xor_cnf(void)
+generate_mont_exp_cnf(void)
 {
+	const size_t bits = maxvar / 2;
 top:
-	outcnf(comment << " The following CNF computes the XOR logarithm of odd value \"a\" " << maxvar << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit result: log_xor(a) = " << r_value << "\n");
+	outcnf(comment << " The following CNF computes the modular exponentiation of two " << bits << " bit\n" <<
+	       comment << " variables: (a ** e) mod n = " << comment_value() << "\n" <<
+	       comment << " using Montgomery multiplication and a " << exp_window << " bit window\n");
+	if (has_m_value)
+		outcnf(comment << " using the fixed modulus " << m_value << "\n");
 
 	do_cnf_reset();
 
 	var_t a;
-	var_t f;
 	var_t e;
+	var_t n;
+	var_t en;
+	var_t f;
 
-	a.alloc(maxvar);
-	f.alloc();
+	a.alloc(bits);
+	e.alloc(bits);
+	mont_modulus(n, bits);
+	f.alloc(bits);
+
+	bind_values(a,e,f);
+	freeze_value(n);
+
+	/* the modulus is parsed together with "e" */
+	for (size_t z = 0; z != bits; z++) {
+		en.z[z] = e.z[z];
+		en.z[z + bits] = n.z[z];
+	}
 
 	if (do_parse) {
-		mpz_class va,vb,vf;
+		mpz_class va,ve,vf;
 
 		while (input_variables(va, a,
-				       vb, var_t(),
+				       ve, en,
 				       vf, f) == 0) {
-			std::cout << "log_xor(" << va << ") = " << vf << "\n";
+			std::cout << va << " ** " << (ve & ((mpz_class(1) << bits) - 1)) <<
+			    " mod " << (ve >> bits) << " = " << vf << "\n";
 		}
 		return;
 	}
 
 	for (size_t z = 0; z != maxvar; z++)
-		outcnf(comment << " Solution in log_xor(" << a.z[z].v << ") = " << f.z[z].v << "\n");
+		outcnf(comment << " Solution in " << a.z[z].v << " ** " << e.z[z].v << " mod " << n.z[z].v << " = " << f.z[z].v << "\n");
 
 	do_cnf_header();
 
-	a.log_xor().equal_to_var(f);
+	if (has_m_value == 0)
+		n.z[0].equal_to_const(1);
+	(a < n).equal_to_const(true);
 
-	set_values(a,var_t(),f);
+	do_mont_exp(a, e, n, bits, exp_window).equal_to_var(f);
+
+	set_values(a,e,f);
 
 	if (runs++ == 0)
 		goto top;
 }
 
+static const char *
+card_encoder_name(void)
+{
+	switch (card_encoder) {
+	case CARD_SEQUENTIAL:
+		return ("sequential counter");
+	case CARD_SORTER:
+		return ("sorting network");
+	case CARD_ADDER:
+		return ("adder tree");
+	default:
+		return ("totalizer");
+	}
+}
+
 static void
-generate_dual_log_xor_cnf(void)
+generate_card_cnf(void)
 {
 top:
-	outcnf(comment << " The following CNF computes the XOR logarithm of odd value \"a\" and \"b\" " << maxvar << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit result: log_xor(a * b) = " << r_value << "\n");
+	outcnf(comment << " The following CNF computes the number of set bits in a " << maxvar << " bit\n" <<
+	       comment << " variable: popcount(a) = " << comment_value() << "\n" <<
+	       comment << " using a " << card_encoder_name() << "\n");
 
 	do_cnf_reset();
 
 	var_t a;
-	var_t b;
-	var_t c;
-	var_t d;
-	var_t f;
-	var_t e;
 
 	a.alloc();
-	b.alloc();
-	f.alloc();
+
+	bind_values(a,var_t(),var_t());
 
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
 		while (input_variables(va, a,
-				       vb, b,
-				       vf, f) == 0) {
-			std::cout << "log_xor(" << va << " * " << vb << ") = " << vf << "\n";
+				       vb, var_t(),
+				       vf, var_t()) == 0) {
+			std::cout << "popcount(" << va << ") = " << mpz_popcount(va.get_mpz_t()) << "\n";
 		}
 		return;
 	}
 
 	for (size_t z = 0; z != maxvar; z++)
-		outcnf(comment << " Solution in log_xor(" << a.z[z].v << " * " << b.z[z].v << ") = " << f.z[z].v << "\n");
+		outcnf(comment << " Solution in popcount(" << a.z[z].v << ")\n");
 
 	do_cnf_header();
 
-	c = a.log_xor();
-	d = b.log_xor();
-
-	(c & d).equal_to_const(false);
-	(c ^ d).equal_to_var(f);
+	/* the -v value is the count, and not a variable */
+	if (has_a_value && target_sets(0) == false)
+		set_value(a, a_value);
 
-	set_values(a,b,f);
+	for (size_t x = 0; target_next(x); ) {
+		if (r_value < 0 || r_value > maxvar)
+			a.count_equal(maxvar + 1).equal_to_const(true);
+		else
+			a.count_equal(r_value.get_ui()).equal_to_const(true);
+		if (has_a_value && target_sets(0))
+			set_value(a, a_value);
+	}
 
 	if (runs++ == 0)
 		goto top;
 }
 
 static void
-generate_exp_xor_cnf(void)
+generate_pb_cnf(void)
 {
+	const size_t n = weights.size();
+	mpz_class total = 0;
+
+	for (size_t z = 0; z != n; z++)
+		total += weights[z];
+	if (n > maxvar || total >= (mpz_class(1) << maxvar))
+		errx(EX_USAGE, "Sum of weights does not fit in %zu bits", maxvar);
 top:
-	outcnf(comment << " The following CNF computes the XOR exponent of even value \"a\" " << maxvar << " bit\n" <<
-	       comment << " variables into a " << maxvar << " bit result: exp_xor(a) = " << r_value << "\n");
+	outcnf(comment << " The following CNF computes the weighted sum of the bits in a " << n << " bit\n" <<
+	       comment << " variable: (a . w) = " << comment_value() << "\n" <<
+	       comment << " using an adder tree\n");
 
 	do_cnf_reset();
 
 	var_t a;
 	var_t f;
-	var_t e;
 
-	a.alloc(maxvar);
+	a.alloc(n);
 	f.alloc();
 
+	bind_values(a,var_t(),f);
+
 	if (do_parse) {
 		mpz_class va,vb,vf;
 
 		while (input_variables(va, a,
 				       vb, var_t(),
 				       vf, f) == 0) {
-			std::cout << "exp_xor(" << va << ") = " << vf << "\n";
+			std::cout << "(" << va << " . w) = " << vf << "\n";
 		}
 		return;
 	}
 
 	for (size_t z = 0; z != maxvar; z++)
-		outcnf(comment << " Solution in exp_xor(" << a.z[z].v << ") = " << f.z[z].v << "\n");
+		outcnf(comment << " Solution in (" << a.z[z].v << " . w) = " << f.z[z].v << "\n");
 
 	do_cnf_header();
 
-	a.exp_xor().equal_to_var(f);
+	a.weighted_sum(weights).equal_to_var(f);
 
 	set_values(a,var_t(),f);
 
@@ -2770,14 +6538,39 @@ top:
 static void
 usage(void)
 {
-	fprintf(stderr, "Usage: hpsat_generate [-h] -f <n> -b <bits 1..%d> [-g] [-r] [-v <value> ]\n", MAXVAR);
+	fprintf(stderr, "Usage: hpsat_generate [options] -f <n> -b <bits 1..%d> [-A <X>] [-B <X>] [-v <X>]\n", MAXVAR);
+	fprintf(stderr, "       hpsat_generate [options] -i <X>\n");
+	fprintf(stderr, "       hpsat_generate [options] -j <F> [-o <prefix>]\n");
 	fprintf(stderr, "	-V     # output variable limit in CNF header\n");
+	fprintf(stderr, "	-s     # single pass, patch CNF header at end of output\n");
+	fprintf(stderr, "	-o <F> # write output to file instead of standard output\n");
+	fprintf(stderr, "	-S     # print statistics to standard error\n");
+	fprintf(stderr, "	-H <n> # use 2**n entries for gate hashing, 0 disables (default %d)\n", GATE_HASH_BITS);
 	fprintf(stderr, "	-p     # pretty print result from solver via standard input\n");
 	fprintf(stderr, "	-g     # b >= a\n");
 	fprintf(stderr, "	-R     # use output format suitable for hpRsat\n");
+	fprintf(stderr, "	-F <X> # output format: dimacs, xcnf, icnf, hprsat, binary or count\n");
+	fprintf(stderr, "	-T <X> # comma separated values for -v, see -F icnf and -L\n");
+	fprintf(stderr, "	-L <F> # read targets like \"A=3 B=5 v=15\" by line, and write\n");
+	fprintf(stderr, "	       # a CNF file for every target, named by -o and its number\n");
+	fprintf(stderr, "	-K <D> # cache circuits in the given directory, and reuse them\n");
+	fprintf(stderr, "	       # for other -A, -B and -v values\n");
+	fprintf(stderr, "	-j <F> # run the jobs listed by line, like \"-f 3 -b 64 -v 15\",\n");
+	fprintf(stderr, "	       # in parallel, naming outputs and a summary file by -o\n");
 	fprintf(stderr, "	-A <X> # specify \"A\" value\n");
 	fprintf(stderr, "	-B <X> # specify \"B\" value\n");
 	fprintf(stderr, "	-v <X> # specify resulting value\n");
+	fprintf(stderr, "	-C     # build -A, -B and -v values into the circuit as constants\n");
+	fprintf(stderr, "	-O     # simplify clauses in memory before output\n");
+	fprintf(stderr, "	-c     # only output gates feeding the constraints\n");
+	fprintf(stderr, "	-M <X> # multiplier: schoolbook, karatsuba, toom3 or dadda\n");
+	fprintf(stderr, "	-a <X> # adder: selasky, ripple, kogge-stone, brent-kung or sklansky\n");
+	fprintf(stderr, "	-d <X> # divider: restoring or non-restoring\n");
+	fprintf(stderr, "	-m <X> # specify fixed modulus for -f 36 and 37\n");
+	fprintf(stderr, "	-w <n> # use n bit windows for -f 37 (default 1)\n");
+	fprintf(stderr, "	-e <X> # cardinality encoder: totalizer, sequential, sorter or adder\n");
+	fprintf(stderr, "	-W <X> # comma separated weights for -f 39\n");
+	fprintf(stderr, "	-t <n> # use schoolbook multiplication up to n bits (default %d)\n", MUL_THRESHOLD);
 	fprintf(stderr, "	-r     # rounded\n");
 	fprintf(stderr, "	-i <X> # Input binary expression, which must be equal to zero\n");
 	fprintf(stderr, "	-i <(a ^ b) & (c | d)> # Binary expression example\n");
@@ -2813,21 +6606,348 @@ usage(void)
 	fprintf(stderr, "	-f 30  # Generate non-linear log_xor()\n");
 	fprintf(stderr, "	-f 31  # Generate non-linear exp_xor()\n");
 	fprintf(stderr, "	-f 32  # Generate dual non-linear log_xor()\n");
+	fprintf(stderr, "	-f 33  # Generate linear multiplier (Karatsuba)\n");
+	fprintf(stderr, "	-f 34  # Generate linear multiplier (Toom-3)\n");
+	fprintf(stderr, "	-f 35  # Generate linear multiplier (Dadda tree)\n");
+	fprintf(stderr, "	-f 36 [-m <X>] # Generate Montgomery multiplier\n");
+	fprintf(stderr, "	-f 37 [-m <X>] [-w <n>] # Generate modular exponent\n");
+	fprintf(stderr, "	-f 38 -v <X> # Generate cardinality constraint\n");
+	fprintf(stderr, "	-f 39 -W <X> # Generate weighted sum\n");
 	exit(EX_USAGE);
 }
 
+/* one line of the manifest of -j */
+struct job_t {
+	std::vector<std::string> args;
+	size_t nargs;		/* arguments from the manifest */
+	std::string output;
+	struct timespec start;
+	double seconds;
+	off_t bytes;
+	int status;
+	pid_t pid;
+};
+
+/*
+ * Split a manifest line into arguments. Like in the shell, single
+ * quotes keep everything up to the next single quote, and double
+ * quotes keep everything but a backslash, which quotes the next
+ * character, also outside of quotes. Returns false for an unmatched
+ * quote.
+ */
+static bool
+job_split(const char *line, std::vector<std::string> &args)
+{
+	std::string word;
+	bool inword = false;
+	char quote = 0;
+
+	for (const char *ptr = line; *ptr != 0; ptr++) {
+		if (quote == '\'') {
+			if (*ptr == '\'')
+				quote = 0;
+			else
+				word += *ptr;
+		} else if (*ptr == '\\' && ptr[1] != 0) {
+			word += *++ptr;
+			inword = true;
+		} else if (quote == '"') {
+			if (*ptr == '"')
+				quote = 0;
+			else
+				word += *ptr;
+		} else if (*ptr == '\'' || *ptr == '"') {
+			quote = *ptr;
+			inword = true;
+		} else if (strchr(" \t\r\n", *ptr) != NULL) {
+			if (inword)
+				args.push_back(word);
+			word.clear();
+			inword = false;
+		} else {
+			word += *ptr;
+			inword = true;
+		}
+	}
+	if (inword)
+		args.push_back(word);
+	return (quote == 0);
+}
+
+/*
+ * Find the output file of a job, like getopt() does, and check that
+ * the job does not run jobs itself, which would never end.
+ */
+static void
+job_options(job_t &job, size_t n, const char *path)
+{
+	for (size_t x = 0; x != job.args.size(); x++) {
+		const char *arg = job.args[x].c_str();
+
+		if (arg[0] != '-' || arg[1] == 0 || strcmp(arg, "--") == 0)
+			break;
+
+		for (const char *ptr = arg + 1; *ptr != 0; ptr++) {
+			const char *opt = strchr(optstring, *ptr);
+
+			if (*ptr == 'j')
+				errx(EX_DATAERR, "Job %zu in '%s' cannot use -j", n, path);
+			if (opt == NULL || opt[1] != ':')
+				continue;
+
+			/* the rest is the argument of the option */
+			if (ptr[1] == 0) {
+				if (++x == job.args.size())
+					errx(EX_DATAERR, "Job %zu in '%s' misses the argument of -%c", n, path, *ptr);
+				ptr = job.args[x].c_str();
+			} else {
+				ptr++;
+			}
+			if (opt[0] == 'o')
+				job.output = ptr;
+			break;
+		}
+	}
+}
+
+/*
+ * Return the size of the output of a job, which is the sum of all
+ * the "<output>.<n>" files for batch jobs, or -1 if there is none.
+ * The output of a failed job is removed.
+ */
+static off_t
+job_output(const std::string &path, bool failed)
+{
+	struct stat st;
+	off_t total = -1;
+
+	if (stat(path.c_str(), &st) == 0) {
+		total = st.st_size;
+		if (failed)
+			unlink(path.c_str());
+	} else {
+		for (size_t x = 0; ; x++) {
+			const std::string name = path + "." + std::to_string(x);
+
+			if (stat(name.c_str(), &st) != 0)
+				break;
+			total = (total < 0 ? 0 : total) + st.st_size;
+			if (failed)
+				unlink(name.c_str());
+		}
+	}
+	return (failed ? -1 : total);
+}
+
+static void
+job_start(const char *self, const std::vector<std::string> &common, job_t &job)
+{
+	std::vector<char *> argv;
+
+	argv.push_back((char *)self);
+	for (size_t x = 0; x != common.size(); x++)
+		argv.push_back((char *)common[x].c_str());
+	for (size_t x = 0; x != job.args.size(); x++)
+		argv.push_back((char *)job.args[x].c_str());
+	argv.push_back(NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &job.start);
+
+	job.pid = fork();
+	if (job.pid < 0)
+		err(EX_OSERR, "Cannot fork");
+	if (job.pid == 0) {
+		execvp(self, argv.data());
+		warn("Cannot execute '%s'", self);
+		_exit(EX_OSERR);
+	}
+}
+
+/*
+ * Run the jobs listed in a manifest, given as one command line of
+ * options per line, on as many processes as there are CPUs. A new
+ * job is started whenever one completes, so that long and short jobs
+ * even out. The options given together with -j are passed to every
+ * job, and jobs without -o write to "<output>.<n>", for the n-th job.
+ * The exit status, run time and output size of every job are written
+ * to "<output>.summary", or to standard output without -o. The output
+ * of a failed job is removed, and its size is given as -1.
+ */
+static int
+run_jobs(const char *path, const char *self, const std::vector<std::string> &common)
+{
+	FILE *fp = (strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+	std::vector<job_t> jobs;
+	struct timespec t0, t1;
+	char *line = NULL;
+	size_t cap = 0;
+	size_t next = 0;
+	size_t running = 0;
+	size_t failed = 0;
+	long workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (fp == NULL)
+		err(EX_NOINPUT, "Cannot open '%s'", path);
+
+	while (getline(&line, &cap, fp) > 0) {
+		job_t job = {};
+
+		if (line[0] == '#')
+			continue;
+
+		if (job_split(line, job.args) == false)
+			errx(EX_DATAERR, "Job %zu in '%s' has an unmatched quote", jobs.size(), path);
+		if (job.args.empty())
+			continue;
+
+		job.nargs = job.args.size();
+		job_options(job, jobs.size(), path);
+
+		if (job.output.empty()) {
+			if (output_file == NULL)
+				errx(EX_DATAERR, "Job %zu in '%s' needs -o", jobs.size(), path);
+			job.output = std::string(output_file) + "." + std::to_string(jobs.size());
+			job.args.push_back("-o");
+			job.args.push_back(job.output);
+		}
+		jobs.push_back(job);
+	}
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+
+	if (workers < 1)
+		workers = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	while (next != jobs.size() || running != 0) {
+		int status;
+		pid_t pid;
+
+		if (next != jobs.size() && running < (size_t)workers) {
+			job_start(self, common, jobs[next++]);
+			running++;
+			continue;
+		}
+
+		pid = wait(&status);
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EX_OSERR, "Cannot wait for jobs");
+		}
+
+		for (size_t x = 0; x != jobs.size(); x++) {
+			job_t &job = jobs[x];
+
+			if (job.pid != pid)
+				continue;
+
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			job.seconds = (t1.tv_sec - job.start.tv_sec) +
+			    (t1.tv_nsec - job.start.tv_nsec) / 1000000000.0;
+			job.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+			/* remove incomplete output */
+			job.bytes = job_output(job.output, job.status != 0);
+			job.pid = 0;
+			failed += (job.status != 0);
+			running--;
+			break;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if (output_file != NULL) {
+		const std::string summary = std::string(output_file) + ".summary";
+
+		outfd = open(summary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (outfd < 0)
+			err(EX_CANTCREAT, "Cannot open '%s'", summary.c_str());
+	}
+
+	std::ostringstream out;
+	char total[32];
+
+	out << "# job status seconds bytes file options\n";
+	for (size_t x = 0; x != jobs.size(); x++) {
+		const job_t &job = jobs[x];
+		char seconds[32];
+
+		snprintf(seconds, sizeof(seconds), "%.3f", job.seconds);
+		out << x << " " << job.status << " " << seconds << " " <<
+		    job.bytes << " " << job.output;
+		for (size_t y = 0; y != job.nargs; y++) {
+			const std::string &arg = job.args[y];
+
+			/* quote arguments, like in the manifest */
+			out << (arg.empty() ? " ''" : " ");
+			for (size_t z = 0; z != arg.size(); z++) {
+				if (strchr(" \t\"'\\", arg[z]) != NULL)
+					out << "\\";
+				out << arg[z];
+			}
+		}
+		out << "\n";
+	}
+	snprintf(total, sizeof(total), "%.3f", (t1.tv_sec - t0.tv_sec) +
+	    (t1.tv_nsec - t0.tv_nsec) / 1000000000.0);
+	out << "# " << jobs.size() << " jobs, " << failed << " failed, " <<
+	    workers << " workers, " << total << " seconds\n";
+	out_string(out.str());
+	out_flush();
+
+	if (outfd != STDOUT_FILENO)
+		close(outfd);
+
+	if (failed != 0)
+		warnx("%zu of %zu jobs failed", failed, jobs.size());
+	return (failed ? EX_SOFTWARE : 0);
+}
+
 int
 main(int argc, char **argv)
 {
-	const char *const optstring = "ghf:cb:rv:Vi:pA:B:R";
+	std::vector<std::string> job_args;
+	const char *job_file = NULL;
 	int ch;
 
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+
 	while ((ch = getopt(argc, argv, optstring)) != -1) {
+		/* the other options given with -j are passed to every job */
+		if (ch != 'j' && ch != 'o' && ch != '?') {
+			job_args.push_back(std::string("-") + (char)ch);
+			if (strchr(optstring, ch)[1] == ':')
+				job_args.push_back(optarg);
+		}
+
 		switch (ch) {
 		case 'R':
-			output_format = 1;
+			output_format = FORMAT_HPRSAT;
 			comment = "#";
 			break;
+		case 'F':
+			if (strcmp(optarg, "dimacs") == 0) {
+				output_format = FORMAT_DIMACS;
+			} else if (strcmp(optarg, "hprsat") == 0) {
+				output_format = FORMAT_HPRSAT;
+				comment = "#";
+			} else if (strcmp(optarg, "binary") == 0) {
+				output_format = FORMAT_BINARY;
+				output_comments = 0;
+			} else if (strcmp(optarg, "xcnf") == 0) {
+				output_format = FORMAT_XCNF;
+			} else if (strcmp(optarg, "icnf") == 0) {
+				output_format = FORMAT_ICNF;
+			} else if (strcmp(optarg, "count") == 0) {
+				output_format = FORMAT_COUNT;
+				output_comments = 0;
+			} else {
+				usage();
+			}
+			break;
 		case 'p':
 			do_parse = 1;
 			break;
@@ -2892,6 +7012,77 @@ main(int argc, char **argv)
 			if (optarg[0] == '-')
 				r_value = -r_value;
 			break;
+		case 'm':
+			has_m_value = 1;
+			m_value = 0;
+			for (const char *ptr = optarg; *ptr != 0; ptr++) {
+				if (*ptr >= '0' && *ptr <= '9') {
+					m_value *= 10;
+					m_value += *ptr - '0';
+				} else {
+					usage();
+				}
+			}
+			/* the modulus must be odd */
+			if ((m_value & 1) == 0)
+				usage();
+			break;
+		case 'w':
+			exp_window = atoi(optarg);
+			if (exp_window < 1)
+				exp_window = 1;
+			else if (exp_window > 8)
+				exp_window = 8;
+			break;
+		case 'e':
+			if (strcmp(optarg, "totalizer") == 0)
+				card_encoder = CARD_TOTALIZER;
+			else if (strcmp(optarg, "sequential") == 0)
+				card_encoder = CARD_SEQUENTIAL;
+			else if (strcmp(optarg, "sorter") == 0)
+				card_encoder = CARD_SORTER;
+			else if (strcmp(optarg, "adder") == 0)
+				card_encoder = CARD_ADDER;
+			else
+				usage();
+			break;
+		case 'W':
+			weights.clear();
+			weights.push_back(0);
+			for (const char *ptr = optarg; *ptr != 0; ptr++) {
+				if (*ptr >= '0' && *ptr <= '9') {
+					weights.back() *= 10;
+					weights.back() += *ptr - '0';
+				} else if (*ptr == ',') {
+					weights.push_back(0);
+				} else {
+					usage();
+				}
+			}
+			if (weights.size() > MAXVAR)
+				usage();
+			break;
+		case 'T':
+			targets.clear();
+			for (char *ptr = strtok(optarg, ","); ptr != NULL;
+			    ptr = strtok(NULL, ",")) {
+				target_t t = {};
+
+				if (t.value[2].set_str(ptr, 10) != 0)
+					usage();
+				t.has[2] = true;
+				targets.push_back(t);
+			}
+			break;
+		case 'L':
+			target_file = optarg;
+			break;
+		case 'K':
+			cache_dir = optarg;
+			break;
+		case 'j':
+			job_file = optarg;
+			break;
 		case 'g':
 			greater = 1;
 			break;
@@ -2901,17 +7092,162 @@ main(int argc, char **argv)
 		case 'V':
 			varlimit = 1;
 			break;
+		case 's':
+			single_pass = 1;
+			break;
+		case 'o':
+			output_file = optarg;
+			break;
+		case 'S':
+			print_stats = 1;
+			break;
+		case 'C':
+			bind_constants = 1;
+			break;
+		case 'O':
+			simplify = 1;
+			break;
+		case 'c':
+			prune = 1;
+			break;
+		case 'M':
+			if (strcmp(optarg, "schoolbook") == 0)
+				mul_engine = MUL_SCHOOLBOOK;
+			else if (strcmp(optarg, "karatsuba") == 0)
+				mul_engine = MUL_KARATSUBA;
+			else if (strcmp(optarg, "toom3") == 0)
+				mul_engine = MUL_TOOM3;
+			else if (strcmp(optarg, "dadda") == 0)
+				mul_engine = MUL_DADDA;
+			else
+				usage();
+			break;
+		case 'a':
+			if (strcmp(optarg, "selasky") == 0)
+				adder = ADD_SELASKY;
+			else if (strcmp(optarg, "ripple") == 0)
+				adder = ADD_RIPPLE;
+			else if (strcmp(optarg, "kogge-stone") == 0)
+				adder = ADD_KOGGE_STONE;
+			else if (strcmp(optarg, "brent-kung") == 0)
+				adder = ADD_BRENT_KUNG;
+			else if (strcmp(optarg, "sklansky") == 0)
+				adder = ADD_SKLANSKY;
+			else
+				usage();
+			break;
+		case 'd':
+			if (strcmp(optarg, "restoring") == 0)
+				divider = DIV_RESTORING;
+			else if (strcmp(optarg, "non-restoring") == 0)
+				divider = DIV_NON_RESTORING;
+			else
+				usage();
+			break;
+		case 't':
+			mul_threshold = atoi(optarg);
+			if (mul_threshold < 2)
+				mul_threshold = 2;
+			break;
+		case 'H':
+			gate_hash_bits = atoi(optarg);
+			if (gate_hash_bits > 30)
+				gate_hash_bits = 30;
+			else if (gate_hash_bits < 0)
+				gate_hash_bits = 0;
+			else if (gate_hash_bits != 0 && gate_hash_bits < 2)
+				gate_hash_bits = 2;
+			break;
 		default:
 			usage();
 			break;
 		}
 	}
 
+	if (job_file != NULL)
+		return (run_jobs(job_file, argv[0], job_args));
+
+	if (inputexpr == NULL && (maxvar == 0 || function == 0))
+		usage();
+
+	/* only plain clauses can be simplified */
+	if (simplify && (output_format == FORMAT_HPRSAT ||
+	    output_format == FORMAT_XCNF))
+		usage();
+
+	/* the header is written after simplifying */
+	if (simplify)
+		single_pass = 0;
+
+	if (target_file != NULL)
+		read_targets(target_file);
+
+	/* the command line values are used when a target has none */
+	target_base.value[0] = a_value;
+	target_base.value[1] = b_value;
+	target_base.value[2] = r_value;
+	target_base.has[0] = has_a_value;
+	target_base.has[1] = has_b_value;
+	target_base.has[2] = has_r_value;
+
+	if (output_format == FORMAT_ICNF) {
+		/* the constraints for every target are guarded in place */
+		if (targets.empty() && has_r_value) {
+			target_t t = {};
+
+			t.value[2] = r_value;
+			t.has[2] = true;
+			targets.push_back(t);
+		}
+		if (targets.empty() || simplify || prune)
+			usage();
+		shared_comments = 1;
+	} else if (!targets.empty() && do_parse == 0) {
+		/* one file for every target, named by the -o prefix */
+		if (output_file == NULL || simplify || prune ||
+		    output_format != FORMAT_DIMACS)
+			usage();
+		batch = 1;
+		single_pass = 0;
+		shared_comments = 1;
+	}
+
+	/* the comments and checks below use the first target */
+	if (!targets.empty())
+		target_apply(targets[0]);
+
+	if (cache_dir != NULL && do_parse == 0) {
+		if (!targets.empty() || simplify || prune ||
+		    output_format != FORMAT_DIMACS)
+			usage();
+
+		/* constants built into the circuit are part of the key */
+		if (bind_constants && (has_a_value || has_b_value || has_r_value))
+			cache_values = 1;
+
+		if (cache_lookup()) {
+			if (print_stats)
+				do_cnf_stats();
+			return (0);
+		}
+		cache = 1;
+		single_pass = 0;
+		shared_comments = 1;
+	}
+
+	do_cnf_open();
+
+	/* skip the counting pass */
+	if ((single_pass || simplify || batch || cache ||
+	    output_format == FORMAT_COUNT || output_format == FORMAT_ICNF) &&
+	    do_parse == 0)
+		runs = 1;
+
 	if (inputexpr != NULL) {
 		generate_input_cnf();
+		do_cnf_finish();
 		return (0);
-	} else if (maxvar == 0 || function == 0)
-		usage();
+	}
 
 	switch (function) {
 	case 1:
@@ -3012,9 +7348,36 @@ main(int argc, char **argv)
 	case 32:
 		generate_dual_log_xor_cnf();
 		break;
+	case 33:
+		generate_mul_linear_fast_cnf(MUL_KARATSUBA);
+		break;
+	case 34:
+		generate_mul_linear_fast_cnf(MUL_TOOM3);
+		break;
+	case 35:
+		generate_mul_linear_fast_cnf(MUL_DADDA);
+		break;
+	case 36:
+		generate_mont_mul_cnf();
+		break;
+	case 37:
+		generate_mont_exp_cnf();
+		break;
+	case 38:
+		if (has_r_value == 0)
+			usage();
+		generate_card_cnf();
+		break;
+	case 39:
+		if (weights.empty())
+			usage();
+		generate_pb_cnf();
+		break;
 	default:
 		usage();
 		break;
 	}
+
+	do_cnf_finish();
 	return (0);
 }
@@ -0,0 +1,44 @@
+#!/bin/sh
+#
+# Check that -C, which builds the -A, -B and -v values into the
+# circuit as constants, never changes the answer of the solver.
+#
+# Usage: regress.sh [hpsat_generate]
+#
+# The solver is given by SOLVER, and must read DIMACS from standard
+# input and print an "s SATISFIABLE" or "s UNSATISFIABLE" line.
+#
+
+PROG=${1:-./hpsat_generate}
+SOLVER=${SOLVER:-kissat -q}
+FAIL=0
+COUNT=0
+
+if ! command -v ${SOLVER%% *} > /dev/null; then
+	echo "Solver '${SOLVER}' not found, set SOLVER" >&2
+	exit 1
+fi
+
+solve()
+{
+	${PROG} "$@" 2> /dev/null | ${SOLVER} | grep '^s '
+}
+
+for f in $(seq 1 39); do
+	for values in "-A 13 -B 11 -v 143" "-A 7 -v 77" "-B 5 -v 15" \
+	    "-A 3 -B 5 -v 15" "-A 2 -v 4" "-v 35" "-A 9"; do
+		for extra in "" "-O -c"; do
+			args="-f $f -b 8 -m 239 -W 3,4,5 $values $extra"
+			a=$(solve $args)
+			b=$(solve $args -C)
+			COUNT=$((COUNT + 1))
+			if [ "$a" != "$b" ]; then
+				echo "FAIL: $args: '$a' but with -C '$b'"
+				FAIL=$((FAIL + 1))
+			fi
+		done
+	done
+done
+
+echo "$COUNT checks, $FAIL failed"
+[ $FAIL -eq 0 ]